@@ -19,13 +19,51 @@ SOURCES += main.cpp\
     cameraWidget.cpp \
     centerDialog.cpp \
     heightmapwidget.cpp \
-    cameraThread.cpp
+    cameraThread.cpp \
+    captureThread.cpp \
+    frameRing.cpp \
+    frameSource.cpp \
+    laserExtract.cpp \
+    frameBufferPool.cpp \
+    peakDetect.cpp \
+    smoothing.cpp \
+    scanGrid.cpp \
+    rollingHeightmap.cpp \
+    scanPublisher.cpp \
+    displayBuffer.cpp \
+    triangulation.cpp \
+    pointCloud.cpp \
+    pointCloudWriter.cpp \
+    exportWorker.cpp \
+    streamingCloud.cpp \
+    mesher.cpp \
+    normalEstimation.cpp \
+    decimation.cpp
 
 HEADERS  += mainwindow.h \
     cameraWidget.h \
     centerDialog.h \
     heightmapwidget.h \
     cameraThread.h \
+    captureThread.h \
+    frameRing.h \
+    frameSource.h \
+    laserExtract.h \
+    frameBufferPool.h \
+    peakDetect.h \
+    smoothing.h \
+    scanGrid.h \
+    rollingHeightmap.h \
+    scanPublisher.h \
+    displayBuffer.h \
+    triangulation.h \
+    pointCloud.h \
+    pointCloudWriter.h \
+    exportWorker.h \
+    streamingCloud.h \
+    mesher.h \
+    normalEstimation.h \
+    decimation.h \
     settings.h
 
 FORMS    += \
@@ -2,7 +2,14 @@
 #include "QtException.h"
 #include <opencv.hpp>
 #include <QTime>
+#include <QElapsedTimer>
 #include "settings.h"
+#include "laserExtract.h"
+#include "peakDetect.h"
+#include "pointCloudWriter.h"
+#include <QTemporaryFile>
+#include <QFileInfo>
+#include <QProcess>
 #include <QMessageBox>
 #include <QApplication>
 
@@ -17,19 +24,48 @@ CameraThread::CameraThread(QObject *parent) :
 {
     m_iCamera = -1;
     m_cvCapture = NULL;
+    m_source = NULL;
+    m_nProcessed = 0;
+    m_iProcessingNs = 0;
+    m_nDisplaySkipped = 0;
+    m_nMailboxSkippedStart = 0;
     m_camWidget = NULL;
     m_iplImage = NULL;
+    m_threadCapture = new CaptureThread(this);
+    m_threadCapture->setFrameRing(&m_frameRing);
     m_iLiveViewMode = MODE_LIVE_PREPROCESSED;
+    m_bPreprocessRoiOnly = true;
+    m_iSubPixelMode = SUBPIXEL_PARABOLA;
+    m_bSmoothingReport = false;
+    m_iLineWorkers = LINE_WORKERS_AUTO;
+    m_iOverflowPolicy = m_frameRing.overflowPolicy();
+    m_iReplayMode = REPLAY_REALTIME;
+    m_bLineTracking = false;
+    m_iTrackHalfWindow = LINE_TRACK_HALFWINDOW;
+    m_nTrackHits = 0;
+    m_nTrackMisses = 0;
     m_posPoint.setX(-1); m_posPoint.setY(-1);
+    m_posPointF = QPointF(-1, -1);
+    m_iPointDecimation = POINT_DECIMATION_OFF;
+    m_bScanGrowable = false;
+    m_iSliderOffset = 0;
+    m_iScanReset.storeRelease(SCAN_RESET_NONE);
+    m_iScanMode = SCAN_MODE_SLIDER;
+    m_iConveyorClock = CONVEYOR_CLOCK_FRAMES;
+    m_iConveyorCapacity = ROLLING_DEFAULT_CAPACITY;
+    m_iConveyorOrigin = 0;
+    m_bConveyorOrigin = false;
+    m_iFrameSequence = 0;
+    m_iEncoderCount = 0;
     m_bDigitizing = false;
     m_iLinePowerThreshold = 0;
     m_iPointPowerThreshold = 0;
-    //channel 0: position of the maximum found (cvSplit to display this only)
-    //channel 1: energy of the maximum found (0 for "copies"; i.e. we triple lines to fill spaces)
-    //channel 2: zero
+    //m_scanData: height (position of the maximum found) and power of the maximum per sample, allocated by digitize()
     //note: size is transposed with respect to camera resolution because laser scanner is vertical
-    m_scanData = NULL;
-    m_pointCloud = NULL;
+    m_iCalibrationChanged.storeRelease(1);
+    m_threadExport = new ExportWorker(this);
+    connect(m_threadExport, SIGNAL(jobFinished(int,QString,bool)), this, SLOT(exportFinished(int,QString,bool)));
+    connect(m_threadExport, SIGNAL(jobCanceled(int)), this, SLOT(exportCanceled(int)));
 
     m_dScaleX = 1.;
     m_dScaleY = 1.;
@@ -37,10 +73,15 @@ CameraThread::CameraThread(QObject *parent) :
     m_dOffsetX = 0;
     m_dOffsetY = 0;
     m_dOffsetZ = 0;
+    m_dMeshMaxEdge = MESHER_MAX_EDGE_DEFAULT;
+    m_bExportNormals = true;
+    m_iDecimation = DECIMATE_NONE;
+    m_iDecimationStride = 4;
+    m_dVoxelSize = 1.;
 
     //load config file for calibration filenames
-    loadInternalCalibration("internal.xml");
-    loadExternalCalibration("external.xml");
+    loadInternalCalibration("intrinsics.xml");
+    loadExternalCalibration("extrinsics.xml");
 }
 
 /**
@@ -50,10 +91,14 @@ CameraThread::~CameraThread()
 {
     if (m_bDigitizing)
         digitize(false);
-    if (m_iplImage)
-        cvReleaseImage(&m_iplImage);
-    if (m_scanData)
-        cvReleaseImage(&m_scanData);
+    m_frameRing.abort();
+    m_threadCapture->sendTerminationRequest();
+    m_threadCapture->wait();
+    m_threadCapture->setFrameSource(NULL);
+    delete m_source;        //owned since setFrameSource
+    m_source = NULL;
+    m_threadExport->sendTerminationRequest();
+    m_threadExport->wait();
 }
 
 /**
@@ -62,42 +107,146 @@ CameraThread::~CameraThread()
 void CameraThread::sendTerminationRequest()
 {
     m_bTerminationRequest = true;
+    m_threadCapture->sendTerminationRequest();
+    m_frameRing.abort();    //wake up anyone waiting for frames or free slots
 }
 
 /**
-  @brief    note the telling name ;)
+  @brief    set what happens if processing can't keep up with the camera
+  @param    policy  FRAMERING_DROP_OLDEST or FRAMERING_BLOCK
+  **/
+void CameraThread::setOverflowPolicy(int policy)
+{
+    m_iOverflowPolicy = policy;
+    if (m_iReplayMode != REPLAY_FAST)    //fast replay keeps blocking until it is switched off
+        m_frameRing.setOverflowPolicy(policy);
+}
+
+/**
+  @brief    set age above which a frame is counted as late when processing starts
+  @param    ms  age in milliseconds
+  **/
+void CameraThread::setLateThreshold(int ms)
+{
+    m_frameRing.setLateThreshold(ms);
+}
+
+/**
+  @brief    statistics: frames grabbed from camera since thread start
+  **/
+quint64 CameraThread::framesCaptured()
+{
+    return m_frameRing.framesCaptured();
+}
+
+/**
+  @brief    statistics: frames grabbed but never processed since thread start
+  **/
+quint64 CameraThread::framesDropped()
+{
+    return m_frameRing.framesDropped();
+}
+
+/**
+  @brief    statistics: frames which waited longer than the late threshold before processing
+  **/
+quint64 CameraThread::framesLate()
+{
+    return m_frameRing.framesLate();
+}
+
+/**
+  @brief    statistics: working buffer (re)allocations of the processing loop
+
+  Stays constant while resolution and rois don't change
+  **/
+quint64 CameraThread::bufferAllocations()
+{
+    return m_bufferPool.allocations();
+}
+
+/**
+  @brief    statistics: frames processed since thread start
+  **/
+quint64 CameraThread::framesProcessed()
+{
+    return m_nProcessed;
+}
+
+/**
+  @brief    statistics: rows whose line was found inside the tracking window
+  **/
+quint64 CameraThread::trackingHits()
+{
+    return m_nTrackHits;
+}
+
+/**
+  @brief    statistics: rows where tracking failed and the full row was searched
+  **/
+quint64 CameraThread::trackingMisses()
+{
+    return m_nTrackMisses;
+}
+
+/**
+  @brief    statistics: display frames dropped since thread start
+
+  Either all display buffers were still in use or the gui didn't take the frame before the next one was posted.
+  **/
+quint64 CameraThread::framesNotDisplayed()
+{
+    return m_nDisplaySkipped + (m_camWidget ? m_camWidget->mailbox()->framesSkipped() - m_nMailboxSkippedStart : 0);
+}
+
+/**
+  @brief    statistics: mean processing time per frame in ms since thread start
+  **/
+double CameraThread::averageProcessingMs()
+{
+    if (m_nProcessed == 0)
+        return 0.0;
+    return double(m_iProcessingNs) / 1.0e6 / double(m_nProcessed);
+}
+
+/**
+  @brief    load camera intrinsics (camera_matrix, distortion_coefficients)
   @param    filename to load parameters from
   **/
 void CameraThread::loadInternalCalibration(const QString& fileName)
 {
-    //m_camIntrinsics = cvLoad()
+    QMutexLocker lock(&m_mutexCalibration);
+    m_triangulator.loadIntrinsics(fileName);
+    m_iCalibrationChanged.storeRelease(1);
 }
 
 /**
-  @brief    note the telling name ;)
+  @brief    load laser plane, slider step and camera to world transform
   @param    filename to load parameters from
   **/
 void CameraThread::loadExternalCalibration(const QString& fileName)
 {
-
+    QMutexLocker lock(&m_mutexCalibration);
+    m_triangulator.loadExtrinsics(fileName);
+    m_iCalibrationChanged.storeRelease(1);
 }
 
 /**
-  @brief    note the telling name ;)
+  @brief    save camera intrinsics
   @param    filename to save parameters to
   **/
 void CameraThread::saveInternalCalibration(const QString& fileName)
 {
-
+    m_triangulator.saveIntrinsics(fileName);
 }
 
 /**
-  @brief    note the telling name ;)
+  @brief    save laser plane, slider step and camera to world transform
   @param    filename to save parameters to
   **/
 void CameraThread::saveExternalCalibration(const QString& fileName)
 {
-
+    m_triangulator.saveExtrinsics(fileName);
 }
 
 /**
@@ -164,24 +313,75 @@ void CameraThread::setOffsetZ(double offset)
     m_dOffsetZ = offset;
 }
 
+/**
+  @brief    set the depth discontinuity threshold of exported meshes and normals
+  @param    maxEdge longest triangle edge in output units; <= 0 keeps all triangles
+  **/
+void CameraThread::setMeshMaxEdge(double maxEdge)
+{
+    m_dMeshMaxEdge = maxEdge;
+}
+
+/**
+  @brief    estimate normals from the scan grid and write them with exported points
+  **/
+void CameraThread::setExportNormals(bool normals)
+{
+    m_bExportNormals = normals;
+}
+
+/**
+  @brief    thin out exported points and meshes
+  @param    mode    DECIMATE_*
+  **/
+void CameraThread::setDecimation(int mode)
+{
+    m_iDecimation = mode;
+}
+
+/**
+  @brief    set the grid step of DECIMATE_STRIDE
+  @param    stride  keep every stride-th row and column; 1 keeps all
+  **/
+void CameraThread::setDecimationStride(int stride)
+{
+    m_iDecimationStride = qMax(stride, 1);
+}
+
+/**
+  @brief    set the voxel edge length of DECIMATE_VOXEL
+  @param    size    in output units (mm if calibrated)
+  **/
+void CameraThread::setVoxelSize(double size)
+{
+    m_dVoxelSize = size;
+}
+
 /**
   @brief    tell us if we shall digitize
   @parm     digi    do or not to do
   **/
 void CameraThread::digitize(bool digi)
 {
-    m_bDigitizing = digi;
-    if (digi) {
-        if (m_scanData && m_scanData->width == m_roiLine.height() && m_scanData->height == m_roiPoint.width()) {
+    if (digi && m_iScanMode == SCAN_MODE_CONVEYOR) {
+        bool changed;
+        {
+            QMutexLocker lock(&m_mutexRolling);
+            changed = (m_rollingScan.columns() != m_roiLine.height() || m_rollingScan.capacity() != m_iConveyorCapacity);
+        }
+        if (changed) {
+            requestScanReset(SCAN_RESET_CREATE);
+        }
+    } else if (digi) {
+        if (m_scanData.columns() == m_roiLine.height() && m_scanData.isGrowable() == m_bScanGrowable
+                && (m_bScanGrowable || m_scanData.rows() == m_roiPoint.width())) {
             //nothing in the setup has changed, we can continue scanning
+            m_bDigitizing = true;
             return;
         }
-        if (m_scanData) {
-            cvReleaseImage(&m_scanData);
-        }
-        m_scanData = cvCreateImage( cvSize(m_roiLine.height(), m_roiPoint.width()), IPL_DEPTH_64F, 3 );
-        cvZero(m_scanData);
+        requestScanReset(SCAN_RESET_CREATE);
     }
+    m_bDigitizing = digi;
 }
 
 /**
@@ -213,6 +413,61 @@ void CameraThread::setCvCamera(int cvIndex, CvCapture *cvCapture)
 {
     m_iCamera = cvIndex;
     m_cvCapture = cvCapture;
+    setFrameSource(cvCapture ? new CameraFrameSource(cvCapture, cvIndex) : NULL);
+}
+
+/**
+  @brief    set where frames come from
+  @param    source  camera or recording; ownership is taken. Don't call while the thread is running.
+  **/
+void CameraThread::setFrameSource(FrameSource *source)
+{
+    if (isRunning()) {
+        EX_THROW("Don't change the frame source while the camera thread is running!");
+    }
+    if (m_source != source)
+        delete m_source;
+    m_source = source;
+    m_threadCapture->setFrameSource(source);
+}
+
+/**
+  @brief    set pacing of recorded sources
+  @param    mode    REPLAY_REALTIME: at recorded frame rate; REPLAY_FAST: as fast as processing allows
+
+  Fast replay must not lose frames to stay deterministic, so it makes the frame ring block when full;
+  leaving it restores the policy chosen by setOverflowPolicy().
+  **/
+void CameraThread::setReplayMode(int mode)
+{
+    m_iReplayMode = mode;
+    m_threadCapture->setReplayMode(mode);
+    m_frameRing.setOverflowPolicy(mode == REPLAY_FAST ? FRAMERING_BLOCK : m_iOverflowPolicy);
+}
+
+/**
+  @brief    set whether a recording starts over when it ends
+  **/
+void CameraThread::setReplayLoop(bool loop)
+{
+    m_threadCapture->setReplayLoop(loop);
+}
+
+/**
+  @brief    dump all grabbed frames to a raw file for later replay
+  @param    fileName    target file, conventionally *.raw
+  **/
+bool CameraThread::startRecording(const QString &fileName)
+{
+    return m_threadCapture->startRecording(fileName);
+}
+
+/**
+  @brief    stop dumping frames
+  **/
+void CameraThread::stopRecording()
+{
+    m_threadCapture->stopRecording();
 }
 
 /**
@@ -320,6 +575,247 @@ void CameraThread::setRoi(const QRect &roi, int roitype)
     //}
 }
 
+/**
+  @brief    set sub-pixel estimator for the laser line position
+  @param    mode    one of SUBPIXEL_*
+  **/
+void CameraThread::setSubPixelMode(int mode)
+{
+    m_iSubPixelMode = mode;
+}
+
+/**
+  @brief    set implementation of the roi gaussians
+  @param    backend one of SMOOTH_*; SMOOTH_OPENCV is the reference
+  **/
+void CameraThread::setSmoothingBackend(int backend)
+{
+    m_smoother.setBackend(backend);
+}
+
+/**
+  @brief    compare all smoothing backends against cvSmooth on the rois of the next frame; result goes to the debug log
+  **/
+void CameraThread::reportSmoothingAccuracy()
+{
+    m_bSmoothingReport = true;
+}
+
+/**
+  @brief    set number of threads for the line search
+  @param    workers number of threads; LINE_WORKERS_AUTO uses all cores, 1 is serial
+  **/
+void CameraThread::setLineWorkers(int workers)
+{
+    m_iLineWorkers = (workers > 0) ? workers : LINE_WORKERS_AUTO;
+}
+
+/**
+  @brief    enable tracking of the laser line between frames
+  @param    tracking    true: search each row near its previous peak first, full width only if that fails
+  **/
+void CameraThread::setLineTracking(bool tracking)
+{
+    m_bLineTracking = tracking;
+}
+
+/**
+  @brief    set size of the tracking search window
+  @param    halfWidth   pixels searched left and right of the previous peak
+  **/
+void CameraThread::setTrackingWindow(int halfWidth)
+{
+    if (halfWidth < 1) {
+        DEBUG(1, "Warning: tracking window must be positive");
+        return;
+    }
+    m_iTrackHalfWindow = halfWidth;
+}
+
+/**
+  @brief    set decimation of the coarse to fine point search
+  @param    factor  POINT_DECIMATION_OFF: smooth and search the whole point roi at full resolution (default);
+                    else find the maximum on a roi decimated by factor (4 or 8) and refine it at full resolution
+  **/
+void CameraThread::setPointDecimation(int factor)
+{
+    if (factor < POINT_DECIMATION_OFF) {
+        DEBUG(1, "Warning: invalid point decimation");
+        return;
+    }
+    m_iPointDecimation = factor;
+}
+
+/**
+  @brief    enable preprocessing of the roi union only
+  @param    roiOnly true: convert only the area evaluateImage reads, unless the preprocessed image is displayed
+
+  The result of evaluateImage is the same either way; full frames are just a lot more work.
+  **/
+void CameraThread::setPreprocessRoiOnly(bool roiOnly)
+{
+    m_bPreprocessRoiOnly = roiOnly;
+}
+
+/**
+  @brief    get area of a frame that evaluateImage needs preprocessed
+  @param    img     camera frame
+  @return   union of point and line roi, clipped to img; empty if there are no rois
+  **/
+CvRect CameraThread::preprocessArea(const IplImage *img)
+{
+    QRect area = m_roiPoint.united(m_roiLine) & QRect(0, 0, img->width, img->height);
+    if (area.isEmpty())
+        return cvRect(0, 0, 0, 0);
+    return cvRect(area.left(), area.top(), area.width(), area.height());
+}
+
+/**
+  @brief    coarse to fine search of the laser point
+  @param    pointImage  float point roi, unsmoothed; left unchanged
+  @param    pos         output: sub-pixel point position in roi coordinates
+  @return   smoothed intensity at the maximum, comparable to the full resolution search
+
+  The roi is area-decimated by m_iPointDecimation and smoothed with a correspondingly smaller kernel
+  to find the maximum coarsely. Only a window around it, large enough for the full kernel,
+  is smoothed at full resolution. The position is the centroid of the upper half of the peak.
+  **/
+double CameraThread::findPointPyramid(IplImage *pointImage, CvPoint2D32f *pos)
+{
+    const int f = m_iPointDecimation;
+    const int width = pointImage->width;
+    const int height = pointImage->height;
+
+    //coarse
+    CvSize coarseSize = cvSize(qMax(width / f, 1), qMax(height / f, 1));
+    IplImage *coarse = m_bufferPool.image(POOL_POINT_COARSE, coarseSize, IPL_DEPTH_32F, 1);
+    cvResize(pointImage, coarse, CV_INTER_AREA);
+    int k = (POINT_SMOOTH_KERNEL / f) | 1;
+    m_smoother.smooth(coarse, k, k);
+    CvPoint cmax;
+    cvMinMaxLoc(coarse, NULL, NULL, NULL, &cmax);
+    int cx = (2 * cmax.x + 1) * width / (2 * coarse->width);  //center of the coarse pixel
+    int cy = (2 * cmax.y + 1) * height / (2 * coarse->height);
+
+    //fine: window with kernel support around +-2 coarse pixels
+    const int margin = POINT_SMOOTH_KERNEL / 2;
+    const int half = margin + 2 * f;
+    QRect win = QRect(cx - half, cy - half, 2 * half + 1, 2 * half + 1) & QRect(0, 0, width, height);
+    IplImage *fine = m_bufferPool.image(POOL_POINT_FINE, cvSize(win.width(), win.height()), IPL_DEPTH_32F, 1);
+    cvSetImageROI(pointImage, cvRect(win.left(), win.top(), win.width(), win.height()));
+    cvCopy(pointImage, fine);
+    cvResetImageROI(pointImage);
+    m_smoother.smooth(fine, POINT_SMOOTH_KERNEL, POINT_SMOOTH_KERNEL);
+
+    //search only where the smoothing saw all its data, i.e. not next to window borders inside the roi
+    int left = (win.left() > 0) ? margin : 0;
+    int top = (win.top() > 0) ? margin : 0;
+    int right = (win.right() < width - 1) ? fine->width - margin : fine->width;
+    int bottom = (win.bottom() < height - 1) ? fine->height - margin : fine->height;
+    double max;
+    CvPoint loc;
+    cvSetImageROI(fine, cvRect(left, top, qMax(right - left, 1), qMax(bottom - top, 1)));
+    cvMinMaxLoc(fine, NULL, &max, NULL, &loc);
+    cvResetImageROI(fine);
+    loc.x += left;
+    loc.y += top;
+
+    //centroid of the part above half maximum
+    double base = 0.5 * max;
+    double sw = 0.0, sx = 0.0, sy = 0.0;
+    for (int y = qMax(loc.y - POINT_CENTROID_RADIUS, 0); y <= qMin(loc.y + POINT_CENTROID_RADIUS, fine->height - 1); y++) {
+        const float *row = (const float*) (fine->imageData + y * fine->widthStep);
+        for (int x = qMax(loc.x - POINT_CENTROID_RADIUS, 0); x <= qMin(loc.x + POINT_CENTROID_RADIUS, fine->width - 1); x++) {
+            double w = row[x] - base;
+            if (w > 0.0) {
+                sw += w;
+                sx += w * x;
+                sy += w * y;
+            }
+        }
+    }
+    if (sw > 0.0) {
+        pos->x = float(win.left() + sx / sw);
+        pos->y = float(win.top() + sy / sw);
+    } else {
+        pos->x = float(win.left() + loc.x);
+        pos->y = float(win.top() + loc.y);
+    }
+    return max;
+}
+
+/**
+  @brief    enter a line detection into the scan data
+  @param    slider_x    scan data row (point position in point roi)
+  @param    y           scan data column (row in line roi)
+  @param    h           height value
+  @param    power       line power
+  @return   true if the sample was empty before, i.e. this is its first value
+
+  Only touches column y, so different rows may be stored concurrently.
+  **/
+bool CameraThread::storeScanValue(int slider_x, int y, double h, double power)
+{
+    const float old = m_scanData.power(slider_x, y);
+    if (power >= old) {   //if stronger/better than old value; then overwrite it
+        m_scanData.set(slider_x, y, h, power); //todo: make it different from that
+    }
+    //also do the line above, if applicable
+    //rows outside the grid have no power, so they are never touched
+    if (m_scanData.power(slider_x-1, y) != 0.0f) {  //if line above is set
+        m_scanData.set(slider_x-1, y, h, power / 3.);  //lower power for neighbour
+    }
+    if (m_scanData.power(slider_x-2, y) != 0.0f) {
+        m_scanData.set(slider_x-2, y, h, power / 5.);
+    }
+    //also do the line below if applicable
+    if (m_scanData.power(slider_x+1, y) != 0.0f) {
+        m_scanData.set(slider_x+1, y, h, power / 3.);
+    }
+    if (m_scanData.power(slider_x+2, y) != 0.0f) {
+        m_scanData.set(slider_x+2, y, h, power / 5.);
+    }
+    return old == 0.0f;
+}
+
+/**
+  @brief    triangulate the line positions of one accepted profile and append them to m_streamCloud
+  @param    slider_x    slider position of the profile
+  @param    linePos     line position per line roi row, -1 if none or not to be streamed
+  @param    rows        number of line roi rows
+
+  Uses the exact sub-pixel positions, not the quantized heights of m_scanData. Only the first value of
+  every scan sample is streamed (see storeScanValue), so sweeping over the same slider position again
+  doesn't add duplicates; later, stronger values update m_scanData and the export, not the stream.
+  Readers see the points as soon as this returns.
+  **/
+void CameraThread::streamProfile(int slider_x, const float *linePos, int rows)
+{
+    if (m_iCalibrationChanged.testAndSetOrdered(1, 0)) {   //take a private copy; loading happens in the gui thread
+        QMutexLocker lock(&m_mutexCalibration);
+        m_streamTriangulator = m_triangulator;
+    }
+    float p[3];
+    if (m_streamTriangulator.prepare(m_roiLine)) {
+        rows = qMin(rows, m_streamTriangulator.roi().height());
+        for (int y = 0; y < rows; y++) {
+            if (linePos[y] >= 0.0f && m_streamTriangulator.triangulateColumn(y, linePos[y], slider_x, p))
+                m_streamCloud.append(p);
+        }
+    } else if (m_dScaleX != 0. && m_dScaleY != 0. && m_dScaleZ != 0.) {  //linear "triangulation" as in the export
+        for (int y = 0; y < rows; y++) {
+            if (linePos[y] < 0.0f)
+                continue;
+            double h = 255.0 - (double(linePos[y]) * 255.0 / m_roiLine.width());
+            p[0] = float(((double)y - m_dOffsetX)/m_dScaleX);
+            p[1] = float(((double)slider_x - m_dOffsetY)/m_dScaleY);
+            p[2] = float((h - m_dOffsetZ)/(-m_dScaleZ));
+            m_streamCloud.append(p);
+        }
+    }
+    m_streamCloud.commit();
+}
+
 /**
   @brief    heart 1 of the laser scanner: extract point and line
   @param    img     image to process
@@ -338,24 +834,35 @@ IplImage *CameraThread::evaluateImage(IplImage *img, IplImage *debug /*= NULL*/)
 
         cvSetImageROI(img,pRect);
         // sub-image
-        IplImage *pointImage = cvCreateImage( cvSize(pRect.width, pRect.height), IPL_DEPTH_32F, 1 );
+        IplImage *pointImage = m_bufferPool.image(POOL_POINT, cvSize(pRect.width, pRect.height), IPL_DEPTH_32F, 1 );
         //IplImage *temp = cvCreateImage( cvSize(pRect.width, pRect.height), IPL_DEPTH_32F, 1 );
         cvConvertScale(img,pointImage);
         cvResetImageROI(img); // release image ROI
 
         double min, max;
         CvPoint maxloc;
-        cvSmooth( pointImage, pointImage, CV_GAUSSIAN, 31, 31);
-        cvMinMaxLoc( pointImage, &min, &max, NULL, &maxloc);
-        cvReleaseImage( &pointImage);
+        if (m_bSmoothingReport) {
+            DEBUG(1, m_smoother.accuracyReport(pointImage, POINT_SMOOTH_KERNEL, POINT_SMOOTH_KERNEL));
+        }
+        CvPoint2D32f posF;
+        if (m_iPointDecimation > POINT_DECIMATION_OFF) {
+            max = findPointPyramid(pointImage, &posF);
+            maxloc = cvPoint(cvRound(posF.x), cvRound(posF.y));
+        } else {
+            m_smoother.smooth(pointImage, POINT_SMOOTH_KERNEL, POINT_SMOOTH_KERNEL);
+            cvMinMaxLoc( pointImage, &min, &max, NULL, &maxloc);
+            posF = cvPoint2D32f(maxloc.x, maxloc.y);
+        }
         //cvReleaseImage( &temp );
         //DEBUG(1, QString("Point: %1, %2").arg(maxloc.x).arg(maxloc.y));
         if (max >= m_iPointPowerThreshold) {
             m_posPoint.setX(maxloc.x + m_roiPoint.left());
             m_posPoint.setY(maxloc.y + m_roiPoint.top());
+            m_posPointF = QPointF(posF.x + m_roiPoint.left(), posF.y + m_roiPoint.top());
         } else {
             m_posPoint.setX(-1);
             m_posPoint.setY(-1);
+            m_posPointF = QPointF(-1, -1);
         }
 
         emit pointPosition(m_posPoint.x(), m_posPoint.y());
@@ -366,11 +873,14 @@ IplImage *CameraThread::evaluateImage(IplImage *img, IplImage *debug /*= NULL*/)
 
         // sub-image
         cvSetImageROI(img,lRect);
-        IplImage *lineImage = cvCreateImage( cvSize(lRect.width, lRect.height), IPL_DEPTH_32F, 1 );
+        IplImage *lineImage = m_bufferPool.image(POOL_LINE, cvSize(lRect.width, lRect.height), IPL_DEPTH_32F, 1 );
         cvConvertScale(img,lineImage);
         cvResetImageROI(img);
 
-        cvSmooth(lineImage, lineImage, CV_GAUSSIAN, 17,5);
+        if (m_bSmoothingReport) {
+            DEBUG(1, m_smoother.accuracyReport(lineImage, 17, 5));
+        }
+        m_smoother.smooth(lineImage, 17, 5);
         //cvCvtColor(m_iplImage, gray, CV_RGB2GRAY);
         //double lineFilterCoeffs[] = { -3, -2, -1, -1, 0, 1, 2, 5, 7, 11, 7, 5, 2, 1, 0, -1, -1, -2, -3};
         //CvMat lineFilter;
@@ -379,98 +889,188 @@ IplImage *CameraThread::evaluateImage(IplImage *img, IplImage *debug /*= NULL*/)
         //cvFilter2D( lineImage ,lineImage, &lineFilter, cvPoint(-1,-1));
         //cvSmooth(grayF,grayF, CV_GAUSSIAN, 15, 1);
 
-        float power;
-        int   xpos;
-
-        int slider_x = m_posPoint.x() - m_roiPoint.left();
-        for(int y = 0; y < lineImage->height; y++) { //for every row search max
+        applyScanReset();
+        const bool conveyor = (m_iScanMode == SCAN_MODE_CONVEYOR);
+        int slider_x = m_posPoint.x() - m_roiPoint.left() + m_iSliderOffset;
+        bool store = !conveyor && m_bDigitizing && m_posPoint.x() >= 0 && m_scanData.containsRow(slider_x);
+        if (store) {    //tiles for the row and its neighbours; allocation is serial
+            m_scanData.prepareRows(slider_x - 2, slider_x + 2);
+        }
+        qint64 position = 0;    //conveyor: row of this frame's profile
+        bool storeRow = false;
+        if (conveyor && m_bDigitizing) {
+            if (m_iConveyorClock == CONVEYOR_CLOCK_ENCODER) {
+                position = encoderCount();
+            } else {    //capture sequence: frames the ring dropped still advance the part
+                if (!m_bConveyorOrigin) {
+                    m_iConveyorOrigin = qint64(m_iFrameSequence);
+                    m_bConveyorOrigin = true;
+                }
+                position = qint64(m_iFrameSequence) - m_iConveyorOrigin;
+            }
+            storeRow = true;
+        }
+        const int rows = lineImage->height;
+        if (int(m_linePos.size()) < rows)
+            m_linePos.resize(rows);
+        float *linePos = &m_linePos[0];
+        if (store && int(m_streamPos.size()) < rows)
+            m_streamPos.resize(rows);
+        float *streamPos = store ? &m_streamPos[0] : NULL;   //line positions of samples stored for the first time
+        if (storeRow && int(m_rowHeight.size()) < 2 * rows)
+            m_rowHeight.resize(2 * rows);
+        float *rowHeight = storeRow ? &m_rowHeight[0] : NULL;     //conveyor: heights, then powers of this frame's profile
+        float *rowPower = storeRow ? &m_rowHeight[rows] : NULL;
+        if (m_trackRoi != m_roiLine || int(m_lineTrack.size()) < rows) {  //previous peaks refer to another roi
+            m_lineTrack.assign(rows, -1);
+            m_trackRoi = m_roiLine;
+        }
+        int *lineTrack = &m_lineTrack[0];
+        const int width = lineImage->width;
+        const bool tracking = m_bLineTracking;
+        const int halfWindow = m_iTrackHalfWindow;
+        quint64 hits = 0;
+        quint64 misses = 0;
+#if USE_OPENMP
+        int workers = (m_iLineWorkers > 0) ? m_iLineWorkers : omp_get_max_threads();
+        //rows are independent: row y only writes column y of m_scanData
+        #pragma omp parallel for num_threads(workers) schedule(static) if(workers > 1) reduction(+:hits,misses)
+#endif
+        for(int y = 0; y < rows; y++) { //for every row search max
             float *data = (float*) (lineImage->imageData + y * lineImage->widthStep);
-            power = 0;
-            xpos = 0;
-            for(int x = 0; x < lineImage->width; x++) {
-                //data += lineImage->nChannels;
-                ++data;
-                if (*data > power) {
-                    power = *data;
-                    xpos = x;
+            float power = 0.0f;
+            int xmax = -1;
+            int prev = lineTrack[y];
+            if (tracking && prev >= 0) {     //search around last frame's peak first
+                int from = qMax(prev - halfWindow, 0);
+                int to = qMin(prev + halfWindow + 1, width);
+                xmax = peakArgMax(data, from, to, &power);
+                //a maximum on the window edge may be the flank of a peak outside the window
+                if (power < m_iLinePowerThreshold || (xmax == from && from > 0) || (xmax == to - 1 && to < width)) {
+                    xmax = -1;
+                    ++misses;
+                } else {
+                    ++hits;
                 }
             }
-            if (power < m_iLinePowerThreshold)
+            if (xmax < 0) {
+                xmax = peakArgMax(data, 0, width, &power);
+            }
+            if (power < m_iLinePowerThreshold) {
+                lineTrack[y] = -1;
+                linePos[y] = -1.0f;
+                if (store)
+                    streamPos[y] = -1.0f;
+                if (storeRow)
+                    rowPower[y] = 0.0f;
                 continue;
-            if (debug) {
-                cvDrawCircle(debug, cvPoint(xpos + lRect.x,y+lRect.y), 1, cvScalar(0xff,0x00,0xff,0x00), 1);
-            } else {
-                cvDrawCircle(img, cvPoint(xpos + lRect.x,y+lRect.y), 1, cvScalar(0xff), 1);
             }
+            lineTrack[y] = xmax;
+            float xpos = peakRefine(data, width, xmax, m_iSubPixelMode);
+            linePos[y] = xpos;
             double h = 255.0 - (double(xpos) * 255.0 / m_roiLine.width());
-            if (m_bDigitizing && slider_x >= 0 && slider_x < m_scanData->height && xpos >= 0 && xpos < m_scanData->width) {
-                double *data = (double*) (m_scanData->imageData + slider_x*m_scanData->widthStep + m_scanData->nChannels*y*sizeof(double)); //
-                if (power >= *(data+1)) {   //if stronger/better than old value; then overwrite it
-                    *data = h ; //todo: make it different from that
-                    *(data+1) =  power;
-                }
-                //also do the line above, if applicable
-                if (slider_x >= 1) { //if line above exists
-                    data = (double*) (m_scanData->imageData + (slider_x-1)*m_scanData->widthStep + m_scanData->nChannels*y*sizeof(double)); //
-                    if(*(data+1) != 0.0) {   //if line above is unset
-                        *data = h;
-                        *(data+1) = power / 3.; //lower power for neighbour
-                    }
-                }
-                if (slider_x >= 2) { //if line above exists
-                    data = (double*) (m_scanData->imageData + (slider_x-2)*m_scanData->widthStep + m_scanData->nChannels*y*sizeof(double)); //
-                    if(*(data+1) != 0.0) {   //if line above is unset
-                        *data = h;
-                        *(data+1) = power / 5.; //lower power for neighbour
-                    }
-                }
-                //also do the line below if applicable
-                if ((slider_x+1) <  m_scanData->height) { //if line below exists
-                    data = (double*) (m_scanData->imageData + (slider_x+1)*m_scanData->widthStep + m_scanData->nChannels*y*sizeof(double)); //
-                    if(*(data+1) != 0.0) {   //if line below is unset
-                        *data = h;
-                        *(data+1) = power / 3.;
-                    }
-                }
-                //also do the line below if applicable
-                if ((slider_x+2) <  m_scanData->height) { //if line below exists
-                    data = (double*) (m_scanData->imageData + (slider_x+2)*m_scanData->widthStep + m_scanData->nChannels*y*sizeof(double)); //
-                    if(*(data+1) != 0.0) {   //if line below is unset
-                        *data = h;
-                        *(data+1) = power / 5.;
-                    }
-                }
+            if (store) {
+                bool first = (y < m_scanData.columns()) && storeScanValue(slider_x, y, h, power);
+                streamPos[y] = first ? xpos : -1.0f;
+            }
+            if (storeRow) {
+                rowHeight[y] = float(h);
+                rowPower[y] = power;
+            }
+        }
+        m_nTrackHits += hits;
+        m_nTrackMisses += misses;
+        if (debug) {    //drawing is serial; never draw into img: the next row would see the marker
+            for (int y = 0; y < rows; y++) {
+                if (linePos[y] >= 0.0f)
+                    cvDrawCircle(debug, cvPoint(cvRound(linePos[y]) + lRect.x,y+lRect.y), 1, cvScalar(0xff,0x00,0xff,0x00), 1);
             }
         }
-        if (m_bDigitizing) {
-            emit newScanData();
+        if (store) {
+            streamProfile(slider_x, streamPos, rows);
+            m_scanData.touchRows(slider_x - 2, slider_x + 2);
+            publishScanData();
+        } else if (storeRow) {
+            storeRollingRow(position, rowHeight, rowPower, rows);
+            notifyScanData();
         }
-        cvReleaseImage( &lineImage);
     }
+    m_bSmoothingReport = false;
     //QTime toc = QTime::currentTime();
     //DEBUG(1, QString("Took: %1 ms").arg( tic.msecsTo(toc)));
     return img;
 }
 
+/**
+  @brief    size of the display image for frame: the widget's viewport, but never larger than the frame
+  **/
+QSize CameraThread::displaySize(const IplImage *frame)
+{
+    QSize view = m_camWidget->mailbox()->viewportSize();
+    if (view.isEmpty())     //no downscaling
+        return QSize(frame->width, frame->height);
+    return QSize(qMin(view.width(), frame->width), qMin(view.height(), frame->height));
+}
+
+/**
+  @brief    hand a camera frame to the widget through a display buffer
+  @param    frame   8 bit bgr frame; it's copied (or downscaled) once, the widget shares the copy without converting it
+  **/
+void CameraThread::showFrame(const IplImage *frame)
+{
+    if (!m_camWidget)
+        return;
+    QSize size = displaySize(frame);
+    int display = m_displayBuffers.acquire(size.width(), size.height(), frame->nChannels);
+    if (display < 0) {   //gui is still busy with the previous ones
+        ++m_nDisplaySkipped;
+        return;
+    }
+    m_displayBuffers.fill(display, frame);
+    m_camWidget->mailbox()->post(m_displayBuffers.image(display), QSize(frame->width, frame->height));
+}
+
 /**
   @brief    thread's main routine
+
+  Acquisition runs in m_threadCapture; here we only consume frames from the ring
   **/
 void CameraThread::run()
 {
     m_bTerminationRequest = false;  //initially we don't want to kill us
 
-
+    if(!m_source)     {
+        DEBUG(10, "Frame source not ready. Terminating thread.");
+        return;
+    }
+    m_frameRing.reset();
+    if (m_bConveyorOrigin)      //sequence numbers start over; continue the conveyor behind the last row
+        m_iConveyorOrigin -= qint64(m_iFrameSequence) + 1;
+    m_nProcessed = 0;
+    m_iProcessingNs = 0;
+    m_nTrackHits = 0;
+    m_nTrackMisses = 0;
+    m_nDisplaySkipped = 0;
+    m_nMailboxSkippedStart = m_camWidget ? m_camWidget->mailbox()->framesSkipped() : 0;
+    m_lineTrack.clear();
+    DEBUG(10, QString("Laser extraction kernel: %1").arg(laserExtractImplementation()));
+    m_threadCapture->start();
+
+    QElapsedTimer tic;
     while (!m_bTerminationRequest) {
-        if(!m_cvCapture)     {
-            DEBUG(10, "m_cvCapture not ready. Terminating thread.");
-            break;
-        }
-
-        m_iplImage = cvQueryFrame(m_cvCapture);
-        if(m_iplImage->width * m_iplImage->height < 1) {
-            DEBUG(20, "image invalid, retrying");
-            continue;
+        m_iplImage = m_frameRing.pop(100, &m_iFrameSequence);
+        if (!m_iplImage) {  //timeout or abort; loop re-checks termination
+            if (m_threadCapture->isFinished()) {    //end of recording: drain what is left, then leave
+                m_iplImage = m_frameRing.pop(0, &m_iFrameSequence);
+                if (!m_iplImage) {
+                    emit endOfStream();
+                    break;
+                }
+            } else {
+                continue;
+            }
         }
+        tic.start();
 
         //cvConvertScale(g,g,0.2);
         //cvSub(gray, b, gray);
@@ -478,9 +1078,9 @@ void CameraThread::run()
         //cvSmooth(grayF,grayF, CV_GAUSSIAN, 3, 3);
 
         if ((m_iLiveViewMode == MODE_LIVE_CHESSBOARD) || (m_iLiveViewMode == MODE_LIVE_CHESSBOARD_SAVE)) {
-            IplImage* gray = cvCreateImage(cvSize(m_iplImage->width, m_iplImage->height), m_iplImage->depth, 1);
+            IplImage* gray = m_bufferPool.image(POOL_CHESSBOARD, cvGetSize(m_iplImage), m_iplImage->depth, 1);
             int corner_count;
-            CvPoint2D32f* corners = new CvPoint2D32f[ CALIBRATION_CHESSBOARD_WIDTH *  CALIBRATION_CHESSBOARD_HEIGHT];
+            CvPoint2D32f* corners = m_bufferPool.points( CALIBRATION_CHESSBOARD_WIDTH *  CALIBRATION_CHESSBOARD_HEIGHT);
             int found = cvFindChessboardCorners(m_iplImage, cvSize(CALIBRATION_CHESSBOARD_WIDTH, CALIBRATION_CHESSBOARD_HEIGHT), corners, &corner_count);
             if (found) {
                 // Get subpixel accuracy on those corners
@@ -494,57 +1094,76 @@ void CameraThread::run()
                     m_iLiveViewMode = MODE_LIVE_CHESSBOARD;
                 }
             }
-            cvReleaseImage(&gray);
             // Draw it
             cvDrawChessboardCorners( m_iplImage, cvSize(CALIBRATION_CHESSBOARD_WIDTH, CALIBRATION_CHESSBOARD_HEIGHT), corners, corner_count, found );
-            delete [] corners;
 
-            m_camWidget->setImage(m_iplImage);
+            showFrame(m_iplImage);
         } else {
-            IplImage* gray = cvCreateImage(cvSize(m_iplImage->width, m_iplImage->height), IPL_DEPTH_8U, 1);
-            IplImage *grayF32 = cvCreateImage(cvSize(m_iplImage->width, m_iplImage->height), IPL_DEPTH_32F, 1);
-
-            //truncate to zero; remove negatives
-            float *data;
-            float value;
-            for(int y = 0; y < grayF32->height; y++) { //for every row search max
-                data = (float*) (grayF32->imageData + y * grayF32->widthStep);
-                for(int x = 0; x < grayF32->width; x++) {
-                    //value = 0;
-                    //value +=  *((unsigned char*)(gray->imageData + y*gray->widthStep + x*gray->nChannels ));
-                    value = ((float) ( *((unsigned char*)m_iplImage->imageData + y*m_iplImage->widthStep + x*m_iplImage->nChannels + 2) ));
-                    value -= ((float) ( *((unsigned char*)m_iplImage->imageData + y*m_iplImage->widthStep + x*m_iplImage->nChannels + 1) )) * 0.25;
-                    value -= ((float) ( *((unsigned char*)m_iplImage->imageData + y*m_iplImage->widthStep + x*m_iplImage->nChannels + 0) )) * 0.25;
-
-                    *data = (value > 0.0) ? value : 0.0;
-                    ++data;
-                }
+            IplImage *grayF32 = m_bufferPool.image(POOL_GRAYF32, cvGetSize(m_iplImage), IPL_DEPTH_32F, 1);
+            bool fullFrame = !m_bPreprocessRoiOnly || (MODE_LIVE_PREPROCESSED == m_iLiveViewMode);
+
+            //laser intensity R - 0.25 G - 0.25 B, truncate to zero; remove negatives
+            if (fullFrame) {
+                laserExtract(m_iplImage, grayF32);
+            } else {    //evaluateImage won't look anywhere else; outside stays undefined
+                CvRect area = preprocessArea(m_iplImage);
+                if (area.width > 0 && area.height > 0)
+                    laserExtract(m_iplImage, grayF32, area);
             }
 
-            IplImage* debug = cvCreateImage(cvSize(m_iplImage->width, m_iplImage->height), IPL_DEPTH_8U, 3);
-            cvCvtScale(grayF32, gray);
-            cvCvtColor(gray, debug, CV_GRAY2BGR);    //better send a (formally) color image to the camera widget
+            //debug image is only needed for displaying it; at full display resolution it's drawn right into a display buffer
+            IplImage* debug = NULL;
+            IplImage debugHeader;
+            int display = -1;
+            if (m_camWidget && MODE_LIVE_PREPROCESSED == m_iLiveViewMode) {
+                QSize size = displaySize(m_iplImage);
+                display = m_displayBuffers.acquire(size.width(), size.height(), 3);
+                if (display >= 0) {
+                    IplImage* gray = m_bufferPool.image(POOL_GRAY, cvGetSize(m_iplImage), IPL_DEPTH_8U, 1);
+                    if (size.width() == m_iplImage->width && size.height() == m_iplImage->height) {
+                        debugHeader = m_displayBuffers.mat(display);
+                        debug = &debugHeader;
+                    } else {    //markers are drawn in camera coordinates, downscaled afterwards
+                        debug = m_bufferPool.image(POOL_DEBUG, cvGetSize(m_iplImage), IPL_DEPTH_8U, 3);
+                    }
+                    cvCvtScale(grayF32, gray);
+                    cvCvtColor(gray, debug, CV_GRAY2BGR);    //magenta markers look the same in bgr and rgb order
+                } else {
+                    ++m_nDisplaySkipped;
+                }
+            }
 
             grayF32 = evaluateImage(grayF32,debug);
 
             if (m_camWidget) {
-                if (MODE_LIVE_PREPROCESSED == m_iLiveViewMode) {
-                    m_camWidget->setImage(debug);
+                if (display >= 0) {
+                    if (debug != &debugHeader)
+                        m_displayBuffers.fill(display, debug);
+                    m_camWidget->mailbox()->post(m_displayBuffers.image(display), QSize(m_iplImage->width, m_iplImage->height));
                 } else if (MODE_LIVE_CAMERA == m_iLiveViewMode) {
-                    m_camWidget->setImage(m_iplImage);
-                //else do nothing (MODE_LIVE_NONE == m_iLiveViewMode)
+                    showFrame(m_iplImage);
+                //else do nothing (MODE_LIVE_NONE == m_iLiveViewMode, or no display buffer free)
                 }
             }
-            cvReleaseImage(&debug);
-            cvReleaseImage(&grayF32);
-            cvReleaseImage(&gray);
         }
 
-        //cvReleaseImage(&m_iplImage);  //this one is auto-cleared
+        //cvReleaseImage(&m_iplImage);  //this one is owned by m_frameRing
         //delete [] lineFilterCoeffs;
+        m_iProcessingNs += tic.nsecsElapsed();
+        ++m_nProcessed;
     }
 
-
+    m_threadCapture->sendTerminationRequest();
+    m_frameRing.abort();
+    m_threadCapture->wait();
+    m_iplImage = NULL;
+    DEBUG(10, QString("Frames captured: %1, dropped: %2, late: %3").arg(framesCaptured()).arg(framesDropped()).arg(framesLate()));
+    DEBUG(10, QString("Frames processed: %1, %2 ms per frame").arg(framesProcessed()).arg(averageProcessingMs()));
+    DEBUG(10, QString("Display frames skipped: %1").arg(framesNotDisplayed()));
+    if (m_bLineTracking) {
+        DEBUG(10, QString("Line tracking hits: %1, misses: %2").arg(trackingHits()).arg(trackingMisses()));
+    }
+    DEBUG(10, QString("Buffer allocations: %1 (%2 bytes)").arg(bufferAllocations()).arg(m_bufferPool.bytesAllocated()));
 
     DEBUG(10,"Exiting thread.");
 }
@@ -554,60 +1173,390 @@ void CameraThread::run()
   **/
 void CameraThread::clearHeightmap()
 {
-    if (m_scanData)
-        cvZero(m_scanData);
-    emit newScanData();
+    requestScanReset(SCAN_RESET_CLEAR);
 }
 
+/**
+  @brief    clear or recreate the scan data; done by the processing loop if the thread runs
+  @param    reset   SCAN_RESET_CLEAR or SCAN_RESET_CREATE
+
+  Tiles must not be freed while evaluateImage writes into them.
+  **/
+void CameraThread::requestScanReset(int reset)
+{
+    int pending = m_iScanReset.loadAcquire();
+    while (reset > pending && !m_iScanReset.testAndSetOrdered(pending, reset))    //the stronger reset wins
+        pending = m_iScanReset.loadAcquire();
+    if (!isRunning())
+        applyScanReset();
+}
 
 /**
-  @brief    calculate a 3D point cloud from heightmap and calibration data
+  @brief    carry out a pending scan data reset
 
-  stored in m_pointCloud
+  The request is taken atomically, so one arriving while this one is carried out stays pending.
   **/
-void CameraThread::triangulatePointCloud()
+void CameraThread::applyScanReset()
 {
-    if (m_pointCloud)
-        cvReleaseImage(&m_pointCloud);
+    int reset = m_iScanReset.fetchAndStoreOrdered(SCAN_RESET_NONE);
+    if (reset == SCAN_RESET_NONE)
+        return;
+    if (reset == SCAN_RESET_CREATE && m_iScanMode == SCAN_MODE_CONVEYOR) {
+        QMutexLocker lock(&m_mutexRolling);
+        m_rollingScan.create(m_iConveyorCapacity, m_roiLine.height());
+        m_bConveyorOrigin = false;
+    } else if (reset == SCAN_RESET_CREATE) {
+        if (m_bScanGrowable) {
+            m_scanData.createGrowable(m_roiLine.height());
+        } else {
+            m_scanData.create(m_roiPoint.width(), m_roiLine.height());
+        }
+        m_scanData.setLineRoi(m_roiLine);
+        m_streamCloud.clear();
+    } else {
+        m_scanData.clear();
+        m_streamCloud.clear();
+        {
+            QMutexLocker lock(&m_mutexRolling);
+            m_rollingScan.clear();
+        }
+        m_bConveyorOrigin = false;
+    }
+    publishScanData();
+}
+
+/**
+  @brief    conveyor: store a frame's profile as row of m_rollingScan
+  @param    position    row position
+  @param    height      height per line roi row
+  @param    power       power per line roi row, 0 if there is no sample
+  @param    rows        number of line roi rows
+
+  Profiles are collected outside of m_rollingScan and merged here in one go, so m_mutexRolling is held
+  only for copying a row and the gui's rollingSnapshot() never sees a half written map.
+  **/
+void CameraThread::storeRollingRow(qint64 position, const float *height, const float *power, int rows)
+{
+    QMutexLocker lock(&m_mutexRolling);
+    if (!m_rollingScan.beginRow(position))
+        return;
+    const int columns = qMin(rows, m_rollingScan.columns());
+    for (int y = 0; y < columns; y++) {
+        if (power[y] > 0.0f && power[y] >= m_rollingScan.power(position, y))
+            m_rollingScan.set(position, y, height[y], power[y]);
+    }
+}
 
-    m_pointCloud = cvCreateImage(cvSize(m_scanData->width, m_scanData->height), IPL_DEPTH_64F, 3);
+/**
+  @brief    gui side: consistent copy of the conveyor scan data
+  @return   copy owned by the camera thread, valid and unchanged until the next call; gui thread only
 
-    QTemporaryFile file("temp_XXXXXX.xyz");
-    file.setAutoRemove(false);
-    file.open();
+  Only rows begun since the last call are copied, so the processing loop waits for a few rows at most.
+  **/
+const RollingHeightmap* CameraThread::rollingSnapshot()
+{
+    QMutexLocker lock(&m_mutexRolling);
+    m_rollingScan.copyChangesTo(&m_rollingSnapshot);
+    return &m_rollingSnapshot;
+}
+
+/**
+  @brief    hand the current scan data to the gui and notify it
+  **/
+void CameraThread::publishScanData()
+{
+    m_scanPublisher.publish(m_scanData);
+    notifyScanData();
+}
+
+/**
+  @brief    emit newScanData unless the last one hasn't been answered by scanSnapshot/acknowledgeScanData yet
+
+  Keeps the gui's event queue from filling up with refreshes it can't keep up with.
+  **/
+void CameraThread::notifyScanData()
+{
+    if (m_iScanNotifyPending.testAndSetOrdered(0, 1))
+        emit newScanData();
+}
+
+/**
+  @brief    gui side: note that newScanData was handled, so the next change is signalled again
+  **/
+void CameraThread::acknowledgeScanData()
+{
+    m_iScanNotifyPending.storeRelease(0);
+}
+
+/**
+  @brief    gui side: latest published scan data
+  @return   consistent copy; unchanged until the next call. Only ever call from one (the gui) thread.
+  **/
+const ScanGrid* CameraThread::scanSnapshot()
+{
+    acknowledgeScanData();
+    return m_scanPublisher.acquire();
+}
+
+/**
+  @brief    let the scan data grow with the slider position instead of being bound to the point roi
+  @param    growable    true: rows are allocated in tiles as the slider advances; takes effect with the next digitize()
+  **/
+void CameraThread::setScanGrowable(bool growable)
+{
+    m_bScanGrowable = growable;
+}
+
+/**
+  @brief    set how frames are turned into scan data
+  @param    mode    SCAN_MODE_SLIDER: the laser point gives the row (default);
+                    SCAN_MODE_CONVEYOR: every frame adds a row to m_rollingScan; takes effect with the next digitize()
+  **/
+void CameraThread::setScanMode(int mode)
+{
+    m_iScanMode = mode;
+}
 
-    //cvSmooth(m_pointCloud, m_pointCloud, CV_GAUSSIAN, 7,7);
-    double *data = (double*) m_pointCloud->imageData;
-    double z;
+/**
+  @brief    get how frames are turned into scan data
+  @return   SCAN_MODE_SLIDER or SCAN_MODE_CONVEYOR
+  **/
+int CameraThread::scanMode()
+{
+    return m_iScanMode;
+}
 
-    if (m_dScaleX == 0. || m_dScaleY == 0. || m_dScaleZ == 0.) {
-        QMessageBox::critical(QApplication::activeWindow(), "Error", "Error: One of the scale factors is zero. Division by zero! Cannot triangulate. Aborting.");
+/**
+  @brief    set what advances the conveyor heightmap
+  @param    clock   CONVEYOR_CLOCK_FRAMES: one row per captured frame; CONVEYOR_CLOCK_ENCODER: row is the encoder count
+  **/
+void CameraThread::setConveyorClock(int clock)
+{
+    m_iConveyorClock = clock;
+}
+
+/**
+  @brief    set number of rows the conveyor heightmap keeps; takes effect with the next digitize()
+  **/
+void CameraThread::setConveyorCapacity(int rows)
+{
+    if (rows < 1) {
+        DEBUG(1, "Warning: conveyor capacity must be positive");
         return;
     }
+    m_iConveyorCapacity = rows;
+}
 
-    for (int y = 0; y < m_pointCloud->height; y++) {
-        data = (double*) (m_pointCloud->imageData + y * m_scanData->widthStep);
-        for (int x = 0; x < m_pointCloud->width; x++) { //linear "triangulation"
-            *data = x;
-            ++data;
-            *data = y;
-            ++data;
-            z = *((double*) (m_scanData->imageData + y * m_scanData->widthStep + x * m_scanData->nChannels * sizeof(double))  );
-            *data = z;
-            ++data;
-            if (z != 0)
-                file.write( QString("%1 %2 %3 0. 0. 1.\n").arg(((double)x - m_dOffsetX)/m_dScaleX ).arg(((double)y - m_dOffsetY)/m_dScaleY ).arg(((double)z - m_dOffsetZ)/(-m_dScaleZ)).toLatin1() );
-        }
+/**
+  @brief    feed the external encoder count; may be called from any thread
+  **/
+void CameraThread::setEncoderCount(qint64 count)
+{
+    QMutexLocker lock(&m_mutexEncoder);
+    m_iEncoderCount = count;
+}
+
+/**
+  @brief    get last encoder count fed in by setEncoderCount
+  **/
+qint64 CameraThread::encoderCount()
+{
+    QMutexLocker lock(&m_mutexEncoder);
+    return m_iEncoderCount;
+}
+
+/**
+  @brief    set offset added to the slider position before storing scan data
+  @param    offset  rows; e.g. to continue a growable scan after moving the part
+  **/
+void CameraThread::setSliderOffset(int offset)
+{
+    m_iSliderOffset = offset;
+}
+
+
+/**
+  @brief    take a snapshot of scan data and calibration for a background export
+  @return   new job, NULL if there is nothing to export
+  **/
+ExportJob* CameraThread::createExportJob(const QString &fileName, int format)
+{
+    const ScanGrid *scan = scanSnapshot();
+    if (scan->isEmpty()) {
+        DEBUG(1, "No scan data to triangulate");
+        return NULL;
+    }
+    if (!m_triangulator.isCalibrated() && (m_dScaleX == 0. || m_dScaleY == 0. || m_dScaleZ == 0.)) {
+        DEBUG(1, "Error: One of the scale factors is zero. Division by zero! Cannot triangulate. Aborting.");
+        return NULL;
+    }
+    ExportJob *job = new ExportJob;
+    job->fileName = fileName;
+    job->format = format;
+    job->scan.copyChangedFrom(*scan);
+    {
+        QMutexLocker lock(&m_mutexCalibration);
+        job->triangulator = m_triangulator;
+    }
+    job->roiLine = job->scan.lineRoi();
+    job->scale[0] = m_dScaleX;
+    job->scale[1] = m_dScaleY;
+    job->scale[2] = m_dScaleZ;
+    job->offset[0] = m_dOffsetX;
+    job->offset[1] = m_dOffsetY;
+    job->offset[2] = m_dOffsetZ;
+    job->normals = m_bExportNormals;
+    job->maxEdge = m_dMeshMaxEdge;
+    job->decimation = m_iDecimation;
+    job->stride = m_iDecimationStride;
+    job->voxelSize = m_dVoxelSize;
+    return job;
+}
+
+/**
+  @brief    export the current scan as point cloud in the background
+  @param    fileName    output file
+  @param    format      CLOUD_FORMAT_*; -1 to choose by suffix
+  @return   job id, see exporter() signals; -1 if there is nothing to export
+  **/
+int CameraThread::exportPointCloud(const QString &fileName, int format /*= -1*/)
+{
+    ExportJob *job = createExportJob(fileName, format);
+    if (!job)
+        return -1;
+    return m_threadExport->enqueue(job);
+}
+
+/**
+  @brief    export the current scan as triangle mesh in the background
+  @param    fileName    output file
+  @param    format      MESH_FORMAT_*; -1 to choose by suffix
+  @return   job id, see exporter() signals; -1 if there is nothing to export
+  **/
+int CameraThread::exportMesh(const QString &fileName, int format /*= -1*/)
+{
+    ExportJob *job = createExportJob(fileName, format);
+    if (!job)
+        return -1;
+    job->mesh = true;
+    return m_threadExport->enqueue(job);
+}
+
+/**
+  @brief    export the points triangulated while digitizing, without touching the scan data
+  @param    fileName    output file
+  @param    format      CLOUD_FORMAT_*; -1 to choose by suffix
+  @param    firstPoint  skip points before this one, e.g. the ones a previous export already wrote
+  @return   job id, see exporter() signals; -1 if there are no new points
+  **/
+int CameraThread::exportStreamedPoints(const QString &fileName, int format /*= -1*/, quint64 firstPoint /*= 0*/)
+{
+    ExportJob *job = new ExportJob;
+    job->stream = m_streamCloud.view(firstPoint);
+    if (job->stream.isEmpty()) {
+        DEBUG(1, "No new points to export");
+        delete job;
+        return -1;
     }
-    file.flush();
+    job->fileName = fileName;
+    job->format = format;
+    job->streamed = true;
+    return m_threadExport->enqueue(job);
+}
+
+/**
+  @brief    points triangulated while digitizing; readers take views of it from any thread
+  **/
+StreamingCloud* CameraThread::streamingCloud()
+{
+    return &m_streamCloud;
+}
+
+/**
+  @brief    cancel a background export
+  @param    id  job id returned by exportPointCloud
+  **/
+void CameraThread::cancelExport(int id)
+{
+    m_threadExport->cancel(id);
+}
+
+/**
+  @brief    background exports and their progress signals
+  **/
+ExportWorker* CameraThread::exporter()
+{
+    return m_threadExport;
+}
+
+/**
+  @brief    organized point cloud of the last finished export: 64 bit x, y, z per scan sample, NaN where there is no point
+  **/
+cv::Mat CameraThread::pointCloud()
+{
+    return m_threadExport->lastPointCloud();
+}
+
+/**
+  @brief    normals of pointCloud(): 32 bit unit vectors per scan sample, NaN where there is none
+  **/
+cv::Mat CameraThread::pointNormals()
+{
+    return m_threadExport->lastNormals();
+}
+
+/**
+  @brief    mesh the heightmap with calibration data and show it in MeshLab
+
+  runs in the background, see exportMesh(); the viewer is started when the export has finished
+  **/
+void CameraThread::triangulatePointCloud()
+{
+    QTemporaryFile file("temp_XXXXXX.ply");    //only reserves the name
+    file.setAutoRemove(false);
+    file.open();
     QFileInfo info(file);
+    file.close();
+    int id = exportMesh(info.absoluteFilePath(), MESH_FORMAT_PLY);
+    if (id < 0) {
+        QFile::remove(info.absoluteFilePath());
+        return;
+    }
+    m_viewerJobs.insert(id, info.absoluteFilePath());
+}
+
+/**
+  @brief    a background export is done; open the viewer if it was requested
+
+  The temp file of a failed viewer export is removed, it is of no use to anyone.
+  **/
+void CameraThread::exportFinished(int id, const QString &fileName, bool success)
+{
+    bool viewer = m_viewerJobs.remove(id) > 0;
+    if (!success) {
+        DEBUG(1, QString("Could not write %1").arg(fileName));
+        if (viewer)
+            QFile::remove(fileName);
+        return;
+    }
+    DEBUG(1, QString("Temp-File: %1").arg(fileName));
+    if (!viewer)
+        return;
     QString app("C:\\Program Files (x86)\\VCG\\MeshLab\\meshlab.exe");
     QString path("C:\\Program Files (x86)\\VCG\\MeshLab");
     QStringList args;
-    args.append(info.absoluteFilePath());
-    DEBUG(1, QString("Temp-File: %1").arg(info.absoluteFilePath()));
-    file.close();
+    args.append(fileName);
     QProcess::startDetached(app, args, path);
 }
 
+/**
+  @brief    a background export was canceled; the temp file of a viewer export is removed
+  **/
+void CameraThread::exportCanceled(int id)
+{
+    QString fileName = m_viewerJobs.take(id);
+    if (!fileName.isEmpty())
+        QFile::remove(fileName);
+}
+
 
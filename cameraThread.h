@@ -2,8 +2,23 @@
 #define CAMERATHREAD_H
 
 #include <QThread>
+#include <QMutex>
+#include <QHash>
 #include <opencv.hpp>
 #include <cameraWidget.h>
+#include "frameRing.h"
+#include "captureThread.h"
+#include "frameSource.h"
+#include "frameBufferPool.h"
+#include "smoothing.h"
+#include "scanGrid.h"
+#include "scanPublisher.h"
+#include "rollingHeightmap.h"
+#include "displayBuffer.h"
+#include "triangulation.h"
+#include "exportWorker.h"
+#include "streamingCloud.h"
+#include <vector>
 
 //modes are bitwire or'ed
 #define MODE_NONE       0       ///< mode: do nothing
@@ -17,6 +32,26 @@
 #define MODE_LIVE_CHESSBOARD        3
 #define MODE_LIVE_CHESSBOARD_SAVE   4       ///< save current frame data
 
+#define LINE_WORKERS_AUTO           0       ///< line search uses one thread per core
+#define LINE_TRACK_HALFWINDOW       16      ///< default half width of the line tracking search window
+
+//pending changes of the scan data, carried out by the processing loop
+#define SCAN_RESET_NONE             0
+#define SCAN_RESET_CLEAR            1       ///< remove all samples
+#define SCAN_RESET_CREATE           2       ///< reallocate for current rois and growable setting
+
+//scan modes
+#define SCAN_MODE_SLIDER            0       ///< row of the scan data is the laser point position
+#define SCAN_MODE_CONVEYOR          1       ///< continuous scanning, rows come from a frame counter or encoder
+
+//clocks of the conveyor mode
+#define CONVEYOR_CLOCK_FRAMES       0       ///< one row per captured frame, dropped ones included
+#define CONVEYOR_CLOCK_ENCODER      1       ///< row is the external encoder count
+
+#define POINT_SMOOTH_KERNEL         31      ///< gaussian kernel size for the point roi
+#define POINT_DECIMATION_OFF        1       ///< point search at full resolution only
+#define POINT_CENTROID_RADIUS       3       ///< radius of the sub-pixel centroid around the point maximum
+
 
 /**
   @class    CameraThread    threaded entity that captures camera frames, processes the image (find lasers) and propagates to gui widget
@@ -34,10 +69,16 @@ protected:
 signals:
     void pointPosition(int x, int y);
     void newScanData();
+    void endOfStream();
     
 public slots:
     void sendTerminationRequest();
     void setCvCamera(int cvIndex, CvCapture* cvCapture);
+    void setFrameSource(FrameSource* source);
+    void setReplayMode(int mode);
+    void setReplayLoop(bool loop);
+    bool startRecording(const QString& fileName);
+    void stopRecording();
     void setCameraWidget(CameraWidget* target);
     void setLiveViewMode(int mode);
     int liveViewMode();
@@ -46,12 +87,32 @@ public slots:
     void setRoiPoint(const QRect &roi);
     void setPowerThresholdLine(int value);
     void setRoiLine(const QRect &roi);
+    void setPreprocessRoiOnly(bool roiOnly);
+    void setSubPixelMode(int mode);
+    void setSmoothingBackend(int backend);
+    void reportSmoothingAccuracy();
+    void setLineWorkers(int workers);
+    void setLineTracking(bool tracking);
+    void setTrackingWindow(int halfWidth);
+    void setPointDecimation(int factor);
+    void setScanGrowable(bool growable);
+    void setSliderOffset(int offset);
+    void setScanMode(int mode);
+    int scanMode();
+    void setConveyorClock(int clock);
+    void setConveyorCapacity(int rows);
+    void setEncoderCount(qint64 count);
     void setScaleX(double scale);
     void setScaleY(double scale);
     void setScaleZ(double scale);
     void setOffsetX(double offset);
     void setOffsetY(double offset);
     void setOffsetZ(double offset);
+    void setMeshMaxEdge(double maxEdge);
+    void setExportNormals(bool normals);
+    void setDecimation(int mode);
+    void setDecimationStride(int stride);
+    void setVoxelSize(double size);
     void digitize(bool digi);
     void loadInternalCalibration(const QString& fileName);
     void loadExternalCalibration(const QString& fileName);
@@ -59,31 +120,115 @@ public slots:
     void saveExternalCalibration(const QString& fileName);
     void clearHeightmap();
     void triangulatePointCloud();
+    int exportPointCloud(const QString &fileName, int format = -1);
+    int exportMesh(const QString &fileName, int format = -1);
+    int exportStreamedPoints(const QString &fileName, int format = -1, quint64 firstPoint = 0);
+    void cancelExport(int id);
+    void setOverflowPolicy(int policy);
+    void setLateThreshold(int ms);
+
+public:
+    quint64        framesCaptured();
+    quint64        framesDropped();
+    quint64        framesLate();
+    quint64        framesProcessed();
+    quint64        framesNotDisplayed();
+    double         averageProcessingMs();
+    quint64        trackingHits();
+    quint64        trackingMisses();
+    qint64         encoderCount();
+    const ScanGrid* scanSnapshot();
+    void           acknowledgeScanData();
+    const RollingHeightmap* rollingSnapshot();
+    quint64        bufferAllocations();
+    ExportWorker*  exporter();
+    cv::Mat        pointCloud();
+    cv::Mat        pointNormals();
+    StreamingCloud* streamingCloud();
+
+private slots:
+    void           exportFinished(int id, const QString &fileName, bool success);
+    void           exportCanceled(int id);
 
 private:
     int            captureFrame();
+    QSize          displaySize(const IplImage *frame);
+    void           showFrame(const IplImage *frame);
+    ExportJob*     createExportJob(const QString &fileName, int format);
     void           setModeOfOperation(int mode);
     int            modeOfOperation();
     IplImage*      evaluateImage(IplImage *img, IplImage *debug = NULL);
+    CvRect         preprocessArea(const IplImage *img);
+    bool           storeScanValue(int slider_x, int y, double h, double power);
+    void           streamProfile(int slider_x, const float *linePos, int rows);
+    void           storeRollingRow(qint64 position, const float *height, const float *power, int rows);
+    double         findPointPyramid(IplImage *pointImage, CvPoint2D32f *pos);
+    void           requestScanReset(int reset);
+    void           applyScanReset();
+    void           publishScanData();
+    void           notifyScanData();
 
 private:
     int            m_iMode;                 ///< mode of operation
     bool           m_bTerminationRequest;   ///< internal: thread termination request
     int            m_iCamera;               ///< camera id
     int            m_iLiveViewMode;         ///< live view mode: what is to be sent to the widget
+    bool           m_bPreprocessRoiOnly;    ///< preprocess only the roi union unless the full image is displayed
     CvCapture*     m_cvCapture;             ///< pointer to capture device struct
+    FrameSource*   m_source;                ///< camera or recording to process; owned
+    CaptureThread* m_threadCapture;         ///< grabs frames from m_source into m_frameRing
+    FrameRing      m_frameRing;             ///< preallocated frames between capture and processing
+    int            m_iOverflowPolicy;       ///< FRAMERING_* chosen by the user, overridden while replaying fast
+    int            m_iReplayMode;           ///< REPLAY_*
     CameraWidget*  m_camWidget;             ///< pointer to displaying widget
-    IplImage*      m_iplImage;              ///< image from opencv camera
+    IplImage*      m_iplImage;              ///< image from opencv camera (buffer owned by m_frameRing)
+    FrameBufferPool m_bufferPool;           ///< persistent working images of the processing loop
+    DisplayBufferPool m_displayBuffers;     ///< images shared with m_camWidget without copying, posted to its mailbox
+    quint64        m_nDisplaySkipped;       ///< statistics: frames not displayed, all display buffers busy
+    quint64        m_nMailboxSkippedStart;  ///< widget mailbox skip counter at thread start
+    quint64        m_nProcessed;            ///< statistics: frames processed since thread start
+    qint64         m_iProcessingNs;         ///< statistics: accumulated processing time
     QRect          m_roiLine;               ///< region of interest for line detection
     QRect          m_roiPoint;              ///< region of interest for point detection
     int            m_iLinePowerThreshold;   ///< minimum power to have laser line detected
     int            m_iPointPowerThreshold;  ///< minimum power to have point detected
+    int            m_iSubPixelMode;         ///< sub-pixel estimator for line positions, SUBPIXEL_*
+    GaussianSmoother m_smoother;            ///< roi smoothing
+    bool           m_bSmoothingReport;      ///< compare smoothing backends on the next frame
+    int            m_iLineWorkers;          ///< threads for the line search, LINE_WORKERS_AUTO for all cores
+    std::vector<float> m_linePos;           ///< line position per line roi row of the current frame, -1 if none
+    std::vector<float> m_streamPos;         ///< line position per line roi row of the current frame if it is streamed, -1 otherwise
+    std::vector<float> m_rowHeight;         ///< conveyor: height and power per line roi row of the current frame
+    bool           m_bLineTracking;         ///< search near the previous peak of each row first
+    int            m_iTrackHalfWindow;      ///< half width of the tracking search window
+    std::vector<int> m_lineTrack;           ///< peak column per line roi row of the previous frame, -1 if none
+    QRect          m_trackRoi;              ///< line roi m_lineTrack refers to
+    quint64        m_nTrackHits;            ///< statistics: rows found inside the tracking window
+    quint64        m_nTrackMisses;          ///< statistics: rows that needed a full search after tracking failed
 
 
     QPoint         m_posPoint;              ///< found laser point position
+    QPointF        m_posPointF;             ///< found laser point position, sub-pixel if the pyramid search is used
+    int            m_iPointDecimation;      ///< decimation of the coarse point search, POINT_DECIMATION_OFF for full resolution only
+    bool           m_bScanGrowable;         ///< scan data grows with the slider instead of being bound to the point roi
+    int            m_iSliderOffset;         ///< added to the slider position before storing
+    QAtomicInt     m_iScanReset;            ///< pending SCAN_RESET_* of m_scanData; raised by the gui, taken by the processing loop
+    int            m_iScanMode;             ///< SCAN_MODE_*
+    int            m_iConveyorClock;        ///< CONVEYOR_CLOCK_*
+    int            m_iConveyorCapacity;     ///< rows kept by m_rollingScan
+    qint64         m_iConveyorOrigin;       ///< capture sequence number of conveyor row 0; negative after a restart
+    bool           m_bConveyorOrigin;       ///< m_iConveyorOrigin is set, false until the first frame after a reset
+    quint64        m_iFrameSequence;        ///< capture sequence number of the frame being processed
+    QMutex         m_mutexEncoder;          ///< guards m_iEncoderCount
+    qint64         m_iEncoderCount;         ///< last external encoder count
 
-    cv::Mat        m_camIntrinsics;         ///< camera intrinsic parameters
-    cv::Mat        m_camExtrinsics;         ///< camera extrinsic matrix
+    QMutex         m_mutexCalibration;      ///< guards m_triangulator
+    LaserTriangulator m_triangulator;       ///< camera and laser plane calibration
+    QAtomicInt     m_iCalibrationChanged;   ///< m_streamTriangulator needs a fresh copy of m_triangulator
+    LaserTriangulator m_streamTriangulator; ///< processing loop's copy of the calibration
+    StreamingCloud m_streamCloud;           ///< profiles triangulated while digitizing
+    ExportWorker*  m_threadExport;          ///< triangulates and writes point clouds in the background
+    QHash<int, QString> m_viewerJobs;       ///< export jobs whose result is shown in MeshLab, with their temp file
 
     bool           m_bDigitizing;           ///< state: are we digitizing for 3D?
     double         m_dScaleX;           ///< X-scale factor for triangulation
@@ -92,9 +237,18 @@ private:
     double         m_dOffsetX;           ///< X-Offset  for triangulation
     double         m_dOffsetY;           ///< Y-Offset  for triangulation
     double         m_dOffsetZ;           ///< Z-Offset  for triangulation
+    double         m_dMeshMaxEdge;       ///< depth discontinuity threshold of exported meshes and normals
+    bool           m_bExportNormals;     ///< exported points carry normals estimated on the scan grid
+    int            m_iDecimation;        ///< DECIMATE_* of exports
+    int            m_iDecimationStride;  ///< grid step of DECIMATE_STRIDE
+    double         m_dVoxelSize;         ///< voxel edge length of DECIMATE_VOXEL
+    QMutex         m_mutexRolling;          ///< guards m_rollingScan against rollingSnapshot()
+    RollingHeightmap m_rollingScan;         ///< conveyor mode scan data; written by the processing loop only, others read rollingSnapshot()
+    RollingHeightmap m_rollingSnapshot;     ///< gui's copy of m_rollingScan
 public:
-    IplImage*      m_scanData;              ///< scanned data
-    IplImage*      m_pointCloud;            ///< double x,y,z point cloud data
+    ScanGrid       m_scanData;              ///< scanned data; written by the processing loop only, others read scanSnapshot()
+    ScanPublisher  m_scanPublisher;         ///< consistent copies of m_scanData for the gui
+    QAtomicInt     m_iScanNotifyPending;    ///< newScanData emitted but not yet handled
 
 };
 
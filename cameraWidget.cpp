@@ -20,6 +20,7 @@ CameraWidget::CameraWidget(QWidget *parent) :
     setAttribute(Qt::WA_OpaquePaintEvent);
     m_scaleX = 1.0;
     m_scaleY = 1.0;
+    m_bDownscale = true;
 
     m_cursorX = -1;
     m_cursorY = -1;
@@ -36,6 +37,48 @@ CameraWidget::CameraWidget(QWidget *parent) :
     m_penCursor.setStyle(Qt::DashDotLine);
 
     m_posPoint.setX(-1);    //make invalid
+
+    connect(&m_timerDisplay, SIGNAL(timeout()), this, SLOT(pollMailbox()));
+    m_timerDisplay.start(DISPLAY_REFRESH_MS);
+}
+
+/**
+  @brief    mailbox the processing thread posts display frames to; safe to use from any thread
+  **/
+DisplayMailbox* CameraWidget::mailbox()
+{
+    return &m_mailbox;
+}
+
+/**
+  @brief    show the newest posted frame, if there is one
+  **/
+void CameraWidget::pollMailbox()
+{
+    if (m_mailbox.take(&m_image, &m_sourceSize))
+        update();
+}
+
+/**
+  @brief    enable or disable downscaling of display frames to the widget size
+
+  Worth it whenever the widget is smaller than the camera image (zoom to fit); the processing
+  thread then averages the frame down once instead of QPainter rescaling it on every paint.
+  **/
+void CameraWidget::setDownscaling(bool enable)
+{
+    m_bDownscale = enable;
+    m_mailbox.setViewportSize(enable ? size() : QSize());
+}
+
+/**
+  @brief    tell the processing thread the new display size
+  **/
+void CameraWidget::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    if (m_bDownscale)
+        m_mailbox.setViewportSize(size());
 }
 
 
@@ -47,12 +90,15 @@ CameraWidget::CameraWidget(QWidget *parent) :
 void CameraWidget::setImage(const QImage &img)
 {
     m_image = img;
+    m_sourceSize = img.size();
     update();   //schedule paint event
 }
 
 /**
   @brief    set image from image matrix
-  @param    img matrix class image
+  @param    img matrix class image; it's copied, the caller may reuse it right away
+
+  Buffers that stay valid are better passed as QImage wrapping them (see DisplayBufferPool), that costs no copy at all.
   **/
 void CameraWidget::setImage(const IplImage *img)
 {
@@ -60,43 +106,22 @@ void CameraWidget::setImage(const IplImage *img)
         DEBUG(10, "Image is NULL");
         return;
       }
-      if ( (img->height != m_image.height()) || (img->width != m_image.width()) ) {	//check for image sizes
-          m_image = QImage(img->width, img->height, QImage::Format_RGB32);
-          m_image.fill( 0xff00ffff);
-          DEBUG(10, QString("Created m_image (%1x%2)").arg(m_image.width()).arg(m_image.height()));
-      }
-
-      UINT32 *pDstBase; // = (UINT32*) m_image.bits();
-      int	lineWidthDst = m_image.bytesPerLine();
 
       if ((img->nChannels == 1) && (img->depth == IPL_DEPTH_8U)){
-          UINT32 pixval;
-
-
-          for(int y=0; y < img->height; y++) {
-              for(int x=0; x < img->width; x++) {
-                  pixval = *((UINT8*) (img->imageData + y*img->widthStep + x));
-                  pixval = 0xff000000 | (pixval << 16) | (pixval << 8) | pixval;
-                  //*((UINT32*)  (pDstBase + (x * sizeof(UINT32)))) = pixval;
-              }
-              pDstBase += lineWidthDst;
-          }
+          m_image = QImage((const uchar*) img->imageData, img->width, img->height, img->widthStep, QImage::Format_Grayscale8).copy();
       } else if ((img->nChannels == 3) && (img->depth == IPL_DEPTH_8U)) {
-          //DEBUG(50,"Convert color image");
-          UINT32 pixval;
-          char* pix;
-
-          int y;
-          /* //#pragma omp parallel for private(y,pixval,pix,pDstBase) */
-          for(y=0; y < img->height; y++) {
-              pDstBase = (UINT32*) m_image.scanLine(y);
-              for(int x=0; x < img->width; x++) {
-                  pix = img->imageData + y*img->widthStep + x*img->nChannels;
-                  pixval = 0xFF000000 | (((*(pix+2)) & 0xff)<< 16) | (((*(pix+1)) & 0xff) << 8) | ((*pix) & 0xff);
-                  *(pDstBase + x) = pixval;
-              }
-          }
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+          m_image = QImage((const uchar*) img->imageData, img->width, img->height, img->widthStep, QImage::Format_BGR888).copy();
+#else
+          m_image = QImage((const uchar*) img->imageData, img->width, img->height, img->widthStep, QImage::Format_RGB888).rgbSwapped();
+#endif
       } else if ((img->nChannels == 3) && (img->depth == IPL_DEPTH_32F)) {
+          if ( (img->height != m_image.height()) || (img->width != m_image.width()) || (m_image.format() != QImage::Format_RGB32) ) {	//check for image sizes
+              m_image = QImage(img->width, img->height, QImage::Format_RGB32);
+              m_image.fill( 0xff00ffff);
+              DEBUG(10, QString("Created m_image (%1x%2)").arg(m_image.width()).arg(m_image.height()));
+          }
+          UINT32 *pDstBase;
           //DEBUG(50,"Convert color image");
           UINT32 pixval;
           float* pix;
@@ -115,6 +140,7 @@ void CameraWidget::setImage(const IplImage *img)
           DEBUG(10, "Invalid format of IplImage");
           QMessageBox::critical(this, "Image format error", "Invalid format of IplImage");
       }
+      m_sourceSize = m_image.size();
       update();
 }
 
@@ -201,7 +227,7 @@ QSize CameraWidget::sizeHint()
     if (m_image.isNull())
         return this->rect().size();
     else
-        return m_image.size();
+        return m_sourceSize;
 }
 
 /**
@@ -334,9 +360,9 @@ void CameraWidget::paintEvent(QPaintEvent *event)
         //DEBUG(10,QString("Draw %1 %2 %3 %4").arg(this->rect().left()).arg(this->rect().top()).arg(this->rect().right()).arg(this->rect().bottom()));
         painter.drawImage(this->rect(), m_image);
 
-        //calculate current scale
-        m_scaleX = float(this->rect().width()) / float(m_image.width());
-        m_scaleY = float(this->rect().height()) / float(m_image.height());
+        //calculate current scale; the image may be downscaled already, overlays refer to the camera image
+        m_scaleX = float(this->rect().width()) / float(m_sourceSize.width());
+        m_scaleY = float(this->rect().height()) / float(m_sourceSize.height());
 
         // roi for point
         QRect scaledRoiPoint(m_roiPoint.x() * m_scaleX, m_roiPoint.y() * m_scaleY,
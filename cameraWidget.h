@@ -6,11 +6,13 @@
 #include <QtCore/QRect>
 #include <QtCore/QPoint>
 #include <QtCore/QPointF>
+#include <QtCore/QTimer>
 //#include <opencv.hpp>
 
 #include "opencv2/core/core.hpp"
 #include "opencv2/highgui/highgui.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
+#include "displayBuffer.h"
 
 #define ROI_TYPE_NONE 0
 #define ROI_TYPE_POINT 1
@@ -22,8 +24,14 @@ class CameraWidget : public QWidget
 public:
     explicit CameraWidget(QWidget *parent = 0);
 
+    DisplayMailbox* mailbox();
+
 private:
     QImage  m_image;
+    QSize   m_sourceSize;       //camera image size m_image shows; overlays and mouse are in these coordinates
+    bool    m_bDownscale;       //let the processing thread downscale frames to the widget size
+    DisplayMailbox m_mailbox;   //frames posted by the processing thread
+    QTimer  m_timerDisplay;     //picks frames out of m_mailbox
     QPointF m_posPoint;
     QRect   m_roiPoint;
     QRect   m_roiLine;
@@ -47,6 +55,8 @@ signals:
 public slots:
     void setImage(const QImage &img);
     void setImage(const IplImage *img);
+    void pollMailbox();
+    void setDownscaling(bool enable);
     void setRoi(QRect &roi, int roitype);
     QRect roi(int roitype);
     void tellLaserPos(int x, int y);
@@ -65,6 +75,7 @@ public slots:
     virtual void mouseMoveEvent(QMouseEvent *event);
 
     virtual void paintEvent(QPaintEvent *event);
+    virtual void resizeEvent(QResizeEvent *event);
 };
 
 #endif // CAMERAWIDGET_H
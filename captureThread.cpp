@@ -0,0 +1,147 @@
+#include "captureThread.h"
+#include "QtException.h"
+#include <QElapsedTimer>
+
+CaptureThread::CaptureThread(QObject *parent) :
+    QThread(parent)
+{
+    m_bTerminationRequest = false;
+    m_source = NULL;
+    m_ring = NULL;
+    m_iReplayMode = REPLAY_REALTIME;
+    m_bReplayLoop = false;
+}
+
+/**
+  @brief    cleaning up destructor
+
+  the frame source is owned by the caller
+  **/
+CaptureThread::~CaptureThread()
+{
+    stopRecording();
+}
+
+/**
+  @brief    tell the thread to terminate itself in a clean way
+  **/
+void CaptureThread::sendTerminationRequest()
+{
+    m_bTerminationRequest = true;
+}
+
+/**
+  @brief    set source to grab from
+  @param    source  camera or recording; must outlive the thread
+  **/
+void CaptureThread::setFrameSource(FrameSource *source)
+{
+    m_source = source;
+}
+
+/**
+  @brief    set ring to put the grabbed frames into
+  @param    ring    frame ring, must outlive the thread
+  **/
+void CaptureThread::setFrameRing(FrameRing *ring)
+{
+    m_ring = ring;
+}
+
+/**
+  @brief    set pacing of recorded sources
+  @param    mode    REPLAY_REALTIME or REPLAY_FAST
+  **/
+void CaptureThread::setReplayMode(int mode)
+{
+    m_iReplayMode = mode;
+}
+
+/**
+  @brief    set whether a recording starts over when it ends
+  **/
+void CaptureThread::setReplayLoop(bool loop)
+{
+    m_bReplayLoop = loop;
+}
+
+/**
+  @brief    dump every grabbed frame into a raw file for later replay
+  @param    fileName    file to write
+  **/
+bool CaptureThread::startRecording(const QString &fileName)
+{
+    QMutexLocker lock(&m_mutexRecord);
+    double fps = m_source ? m_source->frameRate() : FRAMESOURCE_DEFAULT_FPS;
+    return m_recorder.open(fileName, fps);
+}
+
+/**
+  @brief    finish dumping frames
+  **/
+void CaptureThread::stopRecording()
+{
+    QMutexLocker lock(&m_mutexRecord);
+    m_recorder.close();
+}
+
+/**
+  @brief    thread's main routine: grab, copy into ring, repeat
+  **/
+void CaptureThread::run()
+{
+    m_bTerminationRequest = false;
+
+    QElapsedTimer clock;
+    clock.start();
+    qint64 frameNo = 0;     //frames delivered since (re)start of replay; for pacing
+
+    while (!m_bTerminationRequest) {
+        if (!m_source || !m_ring) {
+            DEBUG(10, "Frame source not ready. Terminating capture thread.");
+            break;
+        }
+
+        const IplImage *frame = m_source->grab();
+        if (!frame) {
+            if (m_source->isLive()) {   //e.g. unplugged: retry at frame rate instead of spinning
+                DEBUG(20, "image invalid, retrying");
+                msleep(qMax(1, qRound(1000.0 / m_source->frameRate())));
+                continue;
+            }
+            if (m_bReplayLoop && m_source->rewind()) {
+                clock.restart();
+                frameNo = 0;
+                continue;
+            }
+            DEBUG(10, QString("End of %1").arg(m_source->description()));
+            emit endOfStream();
+            break;
+        }
+        if (frame->width * frame->height < 1) {
+            DEBUG(20, "image invalid, retrying");
+            if (m_source->isLive())
+                msleep(qMax(1, qRound(1000.0 / m_source->frameRate())));
+            continue;
+        }
+
+        if (!m_source->isLive() && m_iReplayMode == REPLAY_REALTIME) {
+            qint64 due = qint64(frameNo * 1000.0 / m_source->frameRate());
+            qint64 wait = due - clock.elapsed();
+            if (wait > 0)
+                msleep(wait);
+        }
+        ++frameNo;
+
+        m_mutexRecord.lock();
+        if (m_recorder.isOpen())
+            m_recorder.write(frame);
+        m_mutexRecord.unlock();
+
+        if (!m_ring->push(frame)) {   //ring aborted
+            break;
+        }
+    }
+
+    DEBUG(10, "Exiting capture thread.");
+}
@@ -0,0 +1,49 @@
+#ifndef CAPTURETHREAD_H
+#define CAPTURETHREAD_H
+
+#include <QThread>
+#include <QMutex>
+#include <opencv.hpp>
+#include "frameRing.h"
+#include "frameSource.h"
+
+/**
+  @class    CaptureThread   threaded entity that does nothing but grab frames from a FrameSource into a FrameRing
+
+  Keeps acquisition running at camera speed no matter how long the processing of a single frame takes.
+  Recorded sources are paced to their frame rate or replayed as fast as the ring accepts frames.
+  **/
+class CaptureThread : public QThread
+{
+    Q_OBJECT
+public:
+    explicit CaptureThread(QObject *parent = 0);
+    virtual ~CaptureThread();
+
+    void setFrameSource(FrameSource* source);
+    void setFrameRing(FrameRing* ring);
+    void setReplayMode(int mode);
+    void setReplayLoop(bool loop);
+    bool startRecording(const QString &fileName);
+    void stopRecording();
+
+protected:
+    void run();
+
+signals:
+    void endOfStream();
+
+public slots:
+    void sendTerminationRequest();
+
+private:
+    volatile bool  m_bTerminationRequest;   ///< internal: thread termination request
+    FrameSource*   m_source;                ///< where frames come from; owned by the caller
+    FrameRing*     m_ring;                  ///< target for captured frames
+    int            m_iReplayMode;           ///< REPLAY_REALTIME or REPLAY_FAST; ignored for live sources
+    bool           m_bReplayLoop;           ///< start over at end of a recording
+    QMutex         m_mutexRecord;           ///< guards m_recorder
+    RawDumpWriter  m_recorder;              ///< optional dump of every grabbed frame
+};
+
+#endif // CAPTURETHREAD_H
@@ -92,6 +92,13 @@ void CenterDialog::findCameras(void)
             cvReleaseCapture(&capture);
         }
     }
+    //recordings to replay instead of a camera: --replay <file|directory> on the command line
+    QStringList args = qApp->arguments();
+    for (int i = 1; i < args.count() - 1; i++) {
+        if (args.at(i) == "--replay") {
+            ui->comboCameras->addItem( QString("file: %1").arg(args.at(i+1)) );
+        }
+    }
     if (ui->comboCameras->count() < 1) {
         ui->comboCameras->addItem("No camera found!");
         ui->comboCameras->setEnabled(false);
@@ -110,6 +117,7 @@ void CenterDialog::connectCamera(bool connect)
 {
     if (connect) {
         QString s(ui->comboCameras->currentText());
+        FrameSource *source = NULL;
         if (s.startsWith("cv: ")) {
             s = s.remove(0,4);
             bool ok;
@@ -135,6 +143,18 @@ void CenterDialog::connectCamera(bool connect)
             ui->cameraWidget->setImage(m_iplImage);
             ui->cameraWidget->update();
 
+            source = new CameraFrameSource(m_cvCapture, m_iCamera);
+        } else if (s.startsWith("file: ")) {
+            s = s.remove(0,6);
+            source = FrameSource::createFromPath(s);
+            if (!source) {
+                QMessageBox::critical(this,"Replay failed", QString("Could not open recording %1").arg(s));
+                return;
+            }
+            ui->labelCamProps->setText(QString("Replay: %1").arg(QFileInfo(s).fileName()));
+        }
+
+        if (source) {
            // return;
             if (m_threadCam ) {
                 DEBUG(10, "Warning: deleting a running cameraThread");
@@ -149,13 +169,16 @@ void CenterDialog::connectCamera(bool connect)
 
             m_threadCam = new CameraThread(this);
             m_threadCam->setCameraWidget(ui->cameraWidget);
-            m_threadCam->setCvCamera(m_iCamera, m_cvCapture);
+            m_threadCam->setFrameSource(source);
+            if (qApp->arguments().contains("--replay-fast"))
+                m_threadCam->setReplayMode(REPLAY_FAST);
             setLiveMode(ui->comboLiveViewMode->currentText());
             QTimer::singleShot(500, this,  SLOT(setZoomMode()));   //resize when camera thread is running; bad habit workaround
             m_threadCam->start();
 
             this->connect(m_threadCam, SIGNAL(pointPosition(int,int)), this, SLOT(displayPointPosition(int,int)));
             this->connect(m_threadCam, SIGNAL(newScanData()), this, SLOT(updateHeightmapWidget()));
+            this->connect(m_threadCam, SIGNAL(endOfStream()), this, SLOT(replayFinished()));
             this->connect(ui->buttonHeightmapClear, SIGNAL(clicked()), m_threadCam, SLOT(clearHeightmap()));
             this->connect(ui->button3D, SIGNAL(clicked()), m_threadCam, SLOT(triangulatePointCloud()));
             this->connect(ui->sliderLinePowerThreshold, SIGNAL(valueChanged(int)), m_threadCam, SLOT(setPowerThresholdLine(int)));
@@ -258,7 +281,12 @@ void CenterDialog::calibrateExternalParameters()
 void CenterDialog::updateHeightmapWidget()
 {
     if (m_threadCam) {
-        ui->heightmapWidget->setImage(m_threadCam->m_scanData);
+        if (m_threadCam->scanMode() == SCAN_MODE_CONVEYOR) {
+            m_threadCam->acknowledgeScanData();
+            ui->heightmapWidget->setRollingHeightmap(m_threadCam->rollingSnapshot());
+        } else {
+            ui->heightmapWidget->setScanGrid(m_threadCam->scanSnapshot());
+        }
         ui->heightmapWidget->update();
     }
 }
@@ -276,6 +304,7 @@ void CenterDialog::setZoomMode()
         geo.moveTo(0,0);
         //ui->cameraWidget->setMinimumSize(geo.size());
         ui->cameraWidget->setGeometry(geo);
+        ui->cameraWidget->setDownscaling(true);    //processing thread delivers frames at widget size
         ui->scrollCameraWidget->setHorizontalScrollBarPolicy(Qt::ScrollBarAsNeeded);
         ui->scrollCameraWidget->setVerticalScrollBarPolicy(Qt::ScrollBarAsNeeded);
     } else {
@@ -287,6 +316,7 @@ void CenterDialog::setZoomMode()
         geo.moveTo(0,0);
         geo.setWidth( CAMERA_RESOLUTION_X );
         geo.setHeight( CAMERA_RESOLUTION_Y );
+        ui->cameraWidget->setDownscaling(false);
         ui->cameraWidget->setGeometry(geo);
         ui->cameraWidget->setMinimumSize(geo.size());
 
@@ -359,5 +389,17 @@ void CenterDialog::digitize(bool digi)
         m_threadCam->digitize(digi);
 }
 
+/**
+  @brief    a recording was played to its end: stop digitizing and show that nothing is connected any more
+
+  The finished camera thread is kept until the next connect, so its scan data can still be exported.
+  **/
+void CenterDialog::replayFinished()
+{
+    ui->buttonDigitize->setChecked(false);
+    ui->buttonCamera->setChecked(false);
+    ui->labelCamProps->setText(ui->labelCamProps->text() + " (finished)");
+}
+
 
 #endif // CENTERDIALOG_CPP
@@ -33,6 +33,7 @@ private slots:
     void displayRoiLineCoords(const QRect& rect);
     void calibrateExternalParameters();
     void updateHeightmapWidget();
+    void replayFinished();
 
     void digitize(bool);
 
@@ -0,0 +1,222 @@
+#include "decimation.h"
+#include "QtException.h"
+#include <QHash>
+#include <vector>
+#include <string.h>
+#include <math.h>
+
+#define USE_OPENMP      1       ///< decimate in parallel with openmp
+
+#if USE_OPENMP
+    #include <omp.h>
+#endif
+
+/**
+  @struct   VoxelSum    accumulator of the points in one voxel
+  **/
+struct VoxelSum
+{
+    double  xyz[3];
+    double  normal[3];
+    int     count;
+};
+
+/**
+  @brief    scatter voxel keys over the threads' partitions
+  **/
+static inline quint32 partitionHash(quint64 key)
+{
+    return quint32((key * Q_UINT64_C(0x9E3779B97F4A7C15)) >> 32);
+}
+
+CloudDecimator::CloudDecimator()
+{
+    m_iWorkers = DECIMATION_WORKERS_AUTO;
+}
+
+/**
+  @brief    set number of threads
+  @param    workers number of threads; DECIMATION_WORKERS_AUTO uses all cores, 1 is serial
+  **/
+void CloudDecimator::setWorkers(int workers)
+{
+    m_iWorkers = (workers > 0) ? workers : DECIMATION_WORKERS_AUTO;
+}
+
+int CloudDecimator::workers() const
+{
+#if USE_OPENMP
+    return (m_iWorkers > 0) ? m_iWorkers : omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+/**
+  @brief    keep every stride-th row and column of an organized cloud
+  @param    organized   grid of any element type, e.g. points or normals
+  @param    stride      step in both directions; <= 1 returns the input
+  @return   organized grid with the first sample of every stride x stride block
+  **/
+cv::Mat CloudDecimator::stride(const cv::Mat &organized, int stride) const
+{
+    if (stride <= 1 || organized.empty())
+        return organized;
+    const int rows = (organized.rows + stride - 1) / stride;
+    const int columns = (organized.cols + stride - 1) / stride;
+    const size_t elem = organized.elemSize();
+    cv::Mat result(rows, columns, organized.type());
+#if USE_OPENMP
+    const int workers = this->workers();
+    #pragma omp parallel for num_threads(workers) schedule(static) if(workers > 1)
+#endif
+    for (int y = 0; y < rows; y++) {
+        const uchar *src = organized.ptr<uchar>(y * stride);
+        uchar *dst = result.ptr<uchar>(y);
+        for (int x = 0; x < columns; x++)
+            memcpy(dst + x * elem, src + size_t(x) * stride * elem, elem);
+    }
+    return result;
+}
+
+/**
+  @brief    average the points of an organized cloud per voxel
+  @param    organized   64 bit x, y, z per sample, NaN if invalid
+  @param    normals     32 bit normals in the same layout, NaN if unknown; empty for none
+  @param    voxelSize   edge length of the voxels in output units
+  @param    cloud       receives one point per occupied voxel; has normals if normals is given
+
+  Points are emitted per partition in order of their voxel's first sample, so the result doesn't depend
+  on thread timing. Points farther than 2^(DECIMATION_VOXEL_BITS-1) voxels from the origin on any axis
+  don't fit into a key and are dropped.
+  **/
+void CloudDecimator::voxelize(const cv::Mat &organized, const cv::Mat &normals, double voxelSize, PointCloud *cloud) const
+{
+    const bool withNormals = !normals.empty();
+    cloud->setHasNormals(withNormals);
+    if (organized.empty() || voxelSize <= 0.)
+        return;
+    const int rows = organized.rows;
+    const int columns = organized.cols;
+    const int workers = this->workers();
+    const double scale = 1. / voxelSize;
+    const double bias = double(qint64(1) << (DECIMATION_VOXEL_BITS - 1));
+
+    //voxel key of every sample; range checked before the cast, which is undefined for large values
+    std::vector<quint64> keys(size_t(rows) * columns);
+    qint64 outside = 0;
+#if USE_OPENMP
+    #pragma omp parallel for num_threads(workers) schedule(static) if(workers > 1) reduction(+:outside)
+#endif
+    for (int y = 0; y < rows; y++) {
+        const double *p = organized.ptr<double>(y);
+        quint64 *key = &keys[size_t(y) * columns];
+        for (int x = 0; x < columns; x++, p += 3) {
+            key[x] = DECIMATION_NO_VOXEL;
+            if (p[0] != p[0])       //NaN: no point
+                continue;
+            quint64 k = 0;
+            int i = 0;
+            for (; i < 3; i++) {
+                double v = floor(p[i] * scale) + bias;
+                if (!(v >= 0. && v < 2. * bias))    //also catches infinite and NaN coordinates
+                    break;
+                k = (k << DECIMATION_VOXEL_BITS) | quint64(v);
+            }
+            if (i < 3)
+                ++outside;
+            else
+                key[x] = k;
+        }
+    }
+    if (outside > 0) {
+        DEBUG(1, QString("Voxel grid: dropped %1 points outside the key range, voxel size %2 is too small")
+              .arg(outside).arg(voxelSize));
+    }
+
+    //samples by partition, in sample order: counting sort, so no thread has to scan all keys
+    std::vector<int> partBegin(workers + 1, 0);
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (keys[i] != DECIMATION_NO_VOXEL)
+            partBegin[partitionHash(keys[i]) % quint32(workers) + 1]++;
+    }
+    for (int part = 0; part < workers; part++)
+        partBegin[part + 1] += partBegin[part];
+    std::vector<int> order(partBegin[workers]);
+    {
+        std::vector<int> fill(partBegin.begin(), partBegin.end() - 1);
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (keys[i] != DECIMATION_NO_VOXEL)
+                order[fill[partitionHash(keys[i]) % quint32(workers)]++] = int(i);
+        }
+    }
+
+    //every thread accumulates the voxels of its partition
+    std::vector< std::vector<float> > partPoints(workers);
+    std::vector< std::vector<float> > partNormals(workers);
+#if USE_OPENMP
+    #pragma omp parallel for num_threads(workers) schedule(static, 1) if(workers > 1)
+#endif
+    for (int part = 0; part < workers; part++) {
+        QHash<quint64, int> slots;
+        std::vector<VoxelSum> sums;
+        for (int j = partBegin[part]; j < partBegin[part + 1]; j++) {
+            const int index = order[j];
+            const int y = index / columns;
+            const int x = index % columns;
+            const quint64 key = keys[index];
+            QHash<quint64, int>::iterator it = slots.find(key);
+            if (it == slots.end()) {
+                it = slots.insert(key, int(sums.size()));
+                VoxelSum empty;
+                memset(&empty, 0, sizeof(empty));
+                sums.push_back(empty);
+            }
+            VoxelSum &sum = sums[it.value()];
+            const double *v = organized.ptr<double>(y) + 3 * x;
+            sum.xyz[0] += v[0];
+            sum.xyz[1] += v[1];
+            sum.xyz[2] += v[2];
+            if (withNormals) {
+                const float *n = normals.ptr<float>(y) + 3 * x;
+                if (n[0] == n[0]) {
+                    sum.normal[0] += n[0];
+                    sum.normal[1] += n[1];
+                    sum.normal[2] += n[2];
+                }
+            }
+            sum.count++;
+        }
+        std::vector<float> &points = partPoints[part];
+        std::vector<float> &partNormal = partNormals[part];
+        points.reserve(3 * sums.size());
+        if (withNormals)
+            partNormal.reserve(3 * sums.size());
+        for (size_t i = 0; i < sums.size(); i++) {
+            const VoxelSum &sum = sums[i];
+            for (int k = 0; k < 3; k++)
+                points.push_back(float(sum.xyz[k] / sum.count));
+            if (withNormals) {
+                double len = sqrt(sum.normal[0] * sum.normal[0] + sum.normal[1] * sum.normal[1] + sum.normal[2] * sum.normal[2]);
+                for (int k = 0; k < 3; k++)
+                    partNormal.push_back(len > 0. ? float(sum.normal[k] / len) : 0.0f);
+            }
+        }
+    }
+
+    size_t total = 0;
+    for (int part = 0; part < workers; part++)
+        total += partPoints[part].size() / 3;
+    cloud->reserve(cloud->size() + total);
+    for (int part = 0; part < workers; part++) {
+        const std::vector<float> &points = partPoints[part];
+        for (size_t i = 0; i < points.size(); i += 3) {
+            if (withNormals)
+                cloud->append(&points[i], &partNormals[part][i]);
+            else
+                cloud->append(&points[i]);
+        }
+        std::vector<float>().swap(partPoints[part]);    //release as we go
+        std::vector<float>().swap(partNormals[part]);
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef DECIMATION_H
+#define DECIMATION_H
+
+#include <opencv.hpp>
+#include "pointCloud.h"
+
+//decimation modes
+#define DECIMATE_NONE               0       ///< export every point
+#define DECIMATE_STRIDE             1       ///< every n-th row and column of the scan grid
+#define DECIMATE_VOXEL              2       ///< one averaged point per occupied voxel
+
+#define DECIMATION_WORKERS_AUTO     0       ///< one thread per core
+#define DECIMATION_VOXEL_BITS       21      ///< bits per axis of a voxel key
+#define DECIMATION_NO_VOXEL         (~quint64(0))   ///< key of invalid samples
+
+
+/**
+  @class    CloudDecimator  thin out an organized point cloud before export
+
+  Grid stride keeps an organized cloud organized, so meshes and normals of the result are cheaper too.
+  The voxel grid averages all points (and normals) falling into the same cube. Voxels are assigned
+  to threads by their hash, so each voxel is accumulated by exactly one thread and memory stays at one
+  key and one index per sample plus one accumulator per occupied voxel, regardless of the number of threads.
+  **/
+class CloudDecimator
+{
+public:
+    CloudDecimator();
+
+    void            setWorkers(int workers);
+
+    cv::Mat         stride(const cv::Mat &organized, int stride) const;
+    void            voxelize(const cv::Mat &organized, const cv::Mat &normals, double voxelSize, PointCloud *cloud) const;
+
+private:
+    int             workers() const;
+
+private:
+    int             m_iWorkers;     ///< threads, DECIMATION_WORKERS_AUTO for all cores
+};
+
+#endif // DECIMATION_H
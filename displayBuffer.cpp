@@ -0,0 +1,225 @@
+#include "displayBuffer.h"
+#include "QtException.h"
+
+DisplayBufferPool::DisplayBufferPool()
+{
+    m_iNext = 0;
+    m_nAllocations = 0;
+    for (int i = 0; i < DISPLAY_BUFFER_COUNT; i++) {
+        m_buffers[i] = new DisplayBuffer;
+    }
+}
+
+/**
+  @brief    drop the pool's references; buffers still displayed are deleted with their last image
+  **/
+DisplayBufferPool::~DisplayBufferPool()
+{
+    for (int i = 0; i < DISPLAY_BUFFER_COUNT; i++) {
+        releaseImage(m_buffers[i]);
+        m_buffers[i] = NULL;
+    }
+}
+
+/**
+  @brief    get a buffer no QImage refers to any more
+  @param    width       required width
+  @param    height      required height
+  @param    channels    1 (gray) or 3 (color)
+  @return   buffer index; -1 if all buffers are still displayed
+  **/
+int DisplayBufferPool::acquire(int width, int height, int channels)
+{
+    int type = (channels == 1) ? CV_8UC1 : CV_8UC3;
+    for (int i = 0; i < DISPLAY_BUFFER_COUNT; i++) {
+        int idx = (m_iNext + i) % DISPLAY_BUFFER_COUNT;
+        DisplayBuffer &buf = *m_buffers[idx];
+        if (buf.refs.loadAcquire() != 1)     //some image still refers to it
+            continue;
+        if (buf.mat.cols != width || buf.mat.rows != height || buf.mat.type() != type) {
+            buf.mat.create(height, width, type);
+            ++m_nAllocations;
+        }
+        m_iNext = (idx + 1) % DISPLAY_BUFFER_COUNT;
+        return idx;
+    }
+    return -1;
+}
+
+/**
+  @brief    pixels of a buffer, to render into
+  **/
+cv::Mat& DisplayBufferPool::mat(int index)
+{
+    return m_buffers[index]->mat;
+}
+
+/**
+  @brief    copy a camera image into a buffer, in display channel order
+  @param    index   acquired buffer; if it is smaller than the image, the image is downscaled by area averaging
+  @param    bgr     8 bit image, 3 channel bgr or gray
+  **/
+void DisplayBufferPool::fill(int index, const IplImage *bgr)
+{
+    cv::Mat src = cv::cvarrToMat(bgr);
+    cv::Mat &dst = m_buffers[index]->mat;
+    bool swap = (src.channels() == 3 && !colorIsBgr());
+    if (src.size() != dst.size()) {
+        cv::resize(src, dst, dst.size(), 0, 0, cv::INTER_AREA);
+        if (swap)
+            cv::cvtColor(dst, dst, CV_BGR2RGB);     //on the small image
+    } else if (swap) {
+        cv::cvtColor(src, dst, CV_BGR2RGB);
+    } else {
+        src.copyTo(dst);
+    }
+}
+
+/**
+  @brief    wrap a buffer as QImage; no pixel is copied
+  @return   image sharing the buffer's memory; the buffer is busy until the image and all its copies are destroyed
+  **/
+QImage DisplayBufferPool::image(int index)
+{
+    DisplayBuffer *buf = m_buffers[index];
+    buf->refs.ref();
+    return QImage(buf->mat.data, buf->mat.cols, buf->mat.rows, int(buf->mat.step),
+                  (buf->mat.channels() == 1) ? QImage::Format_Grayscale8 : colorFormat(),
+                  &DisplayBufferPool::releaseImage, buf);
+}
+
+/**
+  @brief    QImage cleanup function: the last image sharing a buffer is gone; also drops the pool's reference
+  **/
+void DisplayBufferPool::releaseImage(void *buffer)
+{
+    DisplayBuffer *buf = static_cast<DisplayBuffer*>(buffer);
+    if (!buf->refs.deref())     //last reference: neither pool nor image left
+        delete buf;
+}
+
+/**
+  @brief    QImage format of color buffers
+  **/
+QImage::Format DisplayBufferPool::colorFormat()
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    return QImage::Format_BGR888;
+#else
+    return QImage::Format_RGB888;
+#endif
+}
+
+/**
+  @brief    true if color buffers take bgr, i.e. camera frames as they are
+  **/
+bool DisplayBufferPool::colorIsBgr()
+{
+    return colorFormat() != QImage::Format_RGB888;
+}
+
+/**
+  @brief    statistics: number of buffer (re)allocations
+  **/
+quint64 DisplayBufferPool::allocations()
+{
+    return m_nAllocations;
+}
+
+/************************************** DisplayMailbox **************************************/
+
+DisplayMailbox::DisplayMailbox()
+{
+    m_bFull = false;
+    m_nPosted = 0;
+    m_nSkipped = 0;
+}
+
+/**
+  @brief    drop a frame into the mailbox, replacing one that wasn't taken yet; never blocks on the gui
+  @param    img         frame to display
+  @param    sourceSize  size of the camera image img shows; img may be downscaled
+  **/
+void DisplayMailbox::post(const QImage &img, const QSize &sourceSize)
+{
+    QImage replaced = img;
+    {
+        QMutexLocker lock(&m_mutex);
+        m_image.swap(replaced);
+        m_sourceSize = sourceSize;
+        if (m_bFull)
+            ++m_nSkipped;
+        m_bFull = true;
+        ++m_nPosted;
+    }
+    //replaced frame is released outside the lock; this may recycle its display buffer
+}
+
+/**
+  @brief    take the newest frame out of the mailbox
+  @param    img         receives the frame; left alone if there is none
+  @param    sourceSize  receives the size of the camera image the frame shows
+  @return   false if nothing new was posted since the last call
+  **/
+bool DisplayMailbox::take(QImage *img, QSize *sourceSize)
+{
+    QImage taken;
+    {
+        QMutexLocker lock(&m_mutex);
+        if (!m_bFull)
+            return false;
+        taken.swap(m_image);
+        *sourceSize = m_sourceSize;
+        m_bFull = false;
+    }
+    img->swap(taken);   //previous image of the caller is released outside the lock
+    return true;
+}
+
+/**
+  @brief    set size the display frames are downscaled to
+  @param    size    widget size; invalid size for full resolution frames
+  **/
+void DisplayMailbox::setViewportSize(const QSize &size)
+{
+    QMutexLocker lock(&m_mutex);
+    m_viewport = size;
+}
+
+/**
+  @brief    get size the display frames are downscaled to; invalid for full resolution
+  **/
+QSize DisplayMailbox::viewportSize()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_viewport;
+}
+
+/**
+  @brief    discard a pending frame
+  **/
+void DisplayMailbox::clear()
+{
+    QImage dropped;
+    QMutexLocker lock(&m_mutex);
+    dropped.swap(m_image);
+    m_bFull = false;
+}
+
+/**
+  @brief    statistics: frames posted
+  **/
+quint64 DisplayMailbox::framesPosted()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_nPosted;
+}
+
+/**
+  @brief    statistics: frames replaced by a newer one before the gui took them
+  **/
+quint64 DisplayMailbox::framesSkipped()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_nSkipped;
+}
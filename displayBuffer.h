@@ -0,0 +1,102 @@
+#ifndef DISPLAYBUFFER_H
+#define DISPLAYBUFFER_H
+
+#include <QImage>
+#include <QAtomicInt>
+#include <QMutex>
+#include <opencv.hpp>
+
+#define DISPLAY_BUFFER_COUNT    3       ///< one being filled, one queued, one painted
+#define DISPLAY_REFRESH_MS      40      ///< gui picks up display frames at 25 Hz
+
+
+/**
+  @struct   DisplayBuffer   display image memory shared between processing thread and gui
+
+  Lives on the heap; whoever drops the last reference deletes it, so images handed to the gui stay valid
+  after the pool (and the camera thread owning it) is gone.
+  **/
+struct DisplayBuffer
+{
+    DisplayBuffer() : refs(1) {}
+
+    cv::Mat     mat;        ///< pixels, 8 bit gray or 3 channel in display order (see DisplayBufferPool::colorFormat)
+    QAtomicInt  refs;       ///< the pool's reference plus one per QImage wrapping mat
+};
+
+
+/**
+  @class    DisplayBufferPool   recycled images the gui displays without copying or converting
+
+  The processing thread renders into a free buffer and hands it out as a QImage that wraps the pixels.
+  The buffer stays busy until the last copy of that QImage is gone (QImage cleanup function), only then it's reused.
+  Buffers are reference counted, so QImages may outlive the pool.
+  Color buffers hold BGR where Qt can display it (Qt >= 5.14), RGB otherwise; fill() takes care of that.
+  Buffers may be smaller than the camera frame, fill() then downscales by area averaging.
+
+  acquire/fill/image: processing thread only. QImages may live in any thread.
+  **/
+class DisplayBufferPool
+{
+public:
+    DisplayBufferPool();
+    virtual ~DisplayBufferPool();
+
+    int             acquire(int width, int height, int channels);
+    cv::Mat&        mat(int index);
+    void            fill(int index, const IplImage *bgr);
+    QImage          image(int index);
+
+    static QImage::Format   colorFormat();
+    static bool             colorIsBgr();
+
+    quint64         allocations();
+
+private:
+    DisplayBufferPool(const DisplayBufferPool &);       //no copies: buffers are shared by reference
+    DisplayBufferPool& operator=(const DisplayBufferPool &);
+    static void     releaseImage(void *buffer);
+
+private:
+    DisplayBuffer  *m_buffers[DISPLAY_BUFFER_COUNT];    ///< the buffers, each holding a reference of the pool
+    int             m_iNext;                            ///< round robin start for acquire
+    quint64         m_nAllocations;                     ///< statistics: (re)allocations
+};
+
+
+/**
+  @class    DisplayMailbox  single slot for the newest display frame, latest frame wins
+
+  The processing thread posts every display frame and never waits for the gui; a frame that wasn't taken
+  before the next one arrives is dropped (and counted). The gui takes the frame at its own refresh rate.
+  Images are shallow copies, the mutex only guards swapping them.
+
+  The gui publishes its viewport size here; the processing thread downscales display frames to it.
+  Frames carry the size of the camera image they show, overlays stay in camera coordinates.
+  **/
+class DisplayMailbox
+{
+public:
+    DisplayMailbox();
+
+    void            post(const QImage &img, const QSize &sourceSize);
+    bool            take(QImage *img, QSize *sourceSize);
+    void            clear();
+
+    void            setViewportSize(const QSize &size);
+    QSize           viewportSize();
+
+    quint64         framesPosted();
+    quint64         framesSkipped();
+
+private:
+    QMutex          m_mutex;            ///< guards all members below
+    QImage          m_image;            ///< newest frame not taken yet
+    QSize           m_sourceSize;       ///< camera image size of m_image
+    QSize           m_viewport;         ///< size to downscale display frames to; invalid for full resolution
+    bool            m_bFull;            ///< m_image holds a frame
+    quint64         m_nPosted;          ///< statistics: frames posted
+    quint64         m_nSkipped;         ///< statistics: frames replaced before the gui took them
+};
+
+#endif // DISPLAYBUFFER_H
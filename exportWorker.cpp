@@ -0,0 +1,385 @@
+#include "exportWorker.h"
+#include "pointCloudWriter.h"
+#include "normalEstimation.h"
+#include "decimation.h"
+#include "QtException.h"
+#include <QFile>
+#include <limits>
+
+ExportWorker::ExportWorker(QObject *parent) :
+    QThread(parent)
+{
+    m_iNextId = 0;
+    m_iCurrent = -1;
+    m_bCancelCurrent = false;
+    m_bTerminationRequest = false;
+}
+
+/**
+  @brief    cleaning up destructor; the running job is canceled, queued ones are dropped
+  **/
+ExportWorker::~ExportWorker()
+{
+    sendTerminationRequest();
+    wait();
+    qDeleteAll(m_queue);
+    m_queue.clear();
+}
+
+/**
+  @brief    tell the thread to cancel the running job and terminate
+  **/
+void ExportWorker::sendTerminationRequest()
+{
+    QMutexLocker lock(&m_mutex);
+    m_bTerminationRequest = true;
+    m_bCancelCurrent = true;
+    m_jobsAvailable.wakeAll();
+}
+
+/**
+  @brief    queue a job behind the ones already waiting
+  @param    job     job to run; ownership goes to the worker
+  @return   job id as used by the signals
+  **/
+int ExportWorker::enqueue(ExportJob *job)
+{
+    QMutexLocker lock(&m_mutex);
+    job->id = m_iNextId++;
+    m_queue.append(job);
+    m_jobsAvailable.wakeOne();
+    if (!isRunning()) {
+        m_bTerminationRequest = false;
+        start(QThread::LowPriority);
+    }
+    return job->id;
+}
+
+/**
+  @brief    cancel a queued or running job
+  **/
+void ExportWorker::cancel(int id)
+{
+    ExportJob *removed = NULL;
+    {
+        QMutexLocker lock(&m_mutex);
+        if (id == m_iCurrent) {
+            m_bCancelCurrent = true;
+            return;
+        }
+        for (int i = 0; i < m_queue.count(); i++) {
+            if (m_queue.at(i)->id == id) {
+                removed = m_queue.takeAt(i);
+                break;
+            }
+        }
+    }
+    if (removed) {
+        delete removed;
+        emit jobCanceled(id);
+    }
+}
+
+/**
+  @brief    cancel the running job and drop all queued ones
+  **/
+void ExportWorker::cancelAll()
+{
+    QList<ExportJob*> removed;
+    {
+        QMutexLocker lock(&m_mutex);
+        m_bCancelCurrent = (m_iCurrent >= 0);
+        removed.swap(m_queue);
+    }
+    for (int i = 0; i < removed.count(); i++) {
+        emit jobCanceled(removed.at(i)->id);
+    }
+    qDeleteAll(removed);
+}
+
+/**
+  @brief    number of jobs waiting or running
+  **/
+int ExportWorker::pendingJobs()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_queue.count() + (m_iCurrent >= 0 ? 1 : 0);
+}
+
+/**
+  @brief    organized point cloud of the last finished job
+  @return   rows x columns of the scan (every stride-th with DECIMATE_STRIDE), 64 bit x, y, z per sample,
+            NaN where there is no point; shared, don't modify
+  **/
+cv::Mat ExportWorker::lastPointCloud()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_lastCloud;
+}
+
+/**
+  @brief    normals of lastPointCloud()
+  @return   32 bit unit normals in the same layout, NaN where there is none; empty if the job had no normals
+  **/
+cv::Mat ExportWorker::lastNormals()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_lastNormals;
+}
+
+/**
+  @brief    true if the running job shall stop
+  **/
+bool ExportWorker::canceled()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_bCancelCurrent;
+}
+
+/**
+  @brief    thread's main routine: process jobs until termination is requested
+  **/
+void ExportWorker::run()
+{
+    forever {
+        ExportJob *job;
+        {
+            QMutexLocker lock(&m_mutex);
+            while (m_queue.isEmpty() && !m_bTerminationRequest)
+                m_jobsAvailable.wait(&m_mutex);
+            if (m_bTerminationRequest)
+                break;
+            job = m_queue.takeFirst();
+            m_iCurrent = job->id;
+            m_bCancelCurrent = false;
+        }
+        emit jobStarted(job->id);
+        bool success = process(job);
+        bool stopped;
+        {
+            QMutexLocker lock(&m_mutex);
+            stopped = m_bCancelCurrent;
+            m_iCurrent = -1;
+        }
+        if (stopped)
+            emit jobCanceled(job->id);
+        else
+            emit jobFinished(job->id, job->fileName, success);
+        delete job;
+    }
+}
+
+/**
+  @brief    triangulate and write one job
+  @return   false on error or cancel; an incomplete file is removed
+  **/
+bool ExportWorker::process(ExportJob *job)
+{
+    if (job->streamed)
+        return writeStream(job);
+
+    cv::Mat organized;
+    if (!triangulate(job, &organized))
+        return false;
+    CloudDecimator decimator;
+    double maxEdge = job->maxEdge;
+    if (job->decimation == DECIMATE_STRIDE && job->stride > 1) {
+        organized = decimator.stride(organized, job->stride);   //full grid is released here
+        maxEdge *= job->stride;                                 //neighbours are farther apart
+    }
+    cv::Mat normals;
+    if (job->normals && !job->mesh && !organized.empty()) {
+        NormalEstimator estimator;
+        estimator.setMaxEdge(maxEdge);
+        estimator.estimate(organized, &normals);
+        if (canceled())
+            return false;
+    }
+    {
+        QMutexLocker lock(&m_mutex);
+        m_lastCloud = organized;
+        m_lastNormals = normals;
+    }
+    if (job->mesh) {
+        if (job->decimation == DECIMATE_VOXEL) {
+            DEBUG(5, "Voxel decimation gives no grid to mesh, exporting the full mesh");
+        }
+        return writeMesh(job, organized, maxEdge);
+    }
+
+    PointCloud cloud;
+    if (job->decimation == DECIMATE_VOXEL && job->voxelSize > 0.) {
+        decimator.voxelize(organized, normals, job->voxelSize, &cloud);
+        DEBUG(10, QString("Voxel grid: %1 points").arg(cloud.size()));
+    } else {
+        gather(organized, normals, &cloud);
+    }
+    if (canceled())
+        return false;
+
+    PointCloudWriter writer;
+    int format = (job->format >= 0) ? job->format : PointCloudWriter::formatFromFileName(job->fileName);
+    if (format < 0 || !writer.open(job->fileName, format, cloud.hasNormals())) {
+        DEBUG(1, QString("Could not export to %1").arg(job->fileName));
+        return false;
+    }
+    bool ok = true;
+    for (size_t first = 0; first < cloud.size() && ok; first += EXPORT_WRITE_CHUNK) {
+        if (canceled()) {
+            ok = false;
+            break;
+        }
+        size_t count = qMin(size_t(EXPORT_WRITE_CHUNK), cloud.size() - first);
+        ok = writer.write(cloud.points() + 3 * first, cloud.normals() ? cloud.normals() + 3 * first : NULL, count);
+    }
+    ok = writer.close() && ok;
+    if (!ok)
+        QFile::remove(job->fileName);
+    return ok;
+}
+
+/**
+  @brief    mesh the organized points of a job and write the triangles
+  @return   false on error or cancel
+  **/
+bool ExportWorker::writeMesh(ExportJob *job, const cv::Mat &organized, double maxEdge)
+{
+    int format = (job->format >= 0) ? job->format : GridMesher::formatFromFileName(job->fileName);
+    if (format < 0) {
+        DEBUG(1, QString("Could not export to %1").arg(job->fileName));
+        return false;
+    }
+    GridMesher mesher;
+    mesher.setMaxEdge(maxEdge);
+    mesher.build(organized);
+    if (canceled())
+        return false;
+    DEBUG(10, QString("Mesh: %1 vertices, %2 triangles").arg(mesher.vertexCount()).arg(mesher.triangleCount()));
+    return mesher.save(job->fileName, format);
+}
+
+/**
+  @brief    write already triangulated points straight from their chunks
+  @return   false on error or cancel; an incomplete file is removed
+  **/
+bool ExportWorker::writeStream(ExportJob *job)
+{
+    const StreamingCloudView &stream = job->stream;
+    PointCloudWriter writer;
+    int format = (job->format >= 0) ? job->format : PointCloudWriter::formatFromFileName(job->fileName);
+    if (format < 0 || !writer.open(job->fileName, format, false)) {
+        DEBUG(1, QString("Could not export to %1").arg(job->fileName));
+        return false;
+    }
+    bool ok = true;
+    int reported = -1;
+    for (size_t i = stream.first(); i < stream.end() && ok; ) {
+        if (canceled()) {
+            ok = false;
+            break;
+        }
+        int percent = int(100. * double(i - stream.first()) / double(stream.size()));
+        if (percent != reported) {
+            emit jobProgress(job->id, percent);
+            reported = percent;
+        }
+        size_t count = stream.run(i);   //one chunk at most
+        ok = writer.write(stream.point(i), NULL, count);
+        i += count;
+    }
+    ok = writer.close() && ok;
+    if (!ok)
+        QFile::remove(job->fileName);
+    else
+        emit jobProgress(job->id, 100);
+    return ok;
+}
+
+/**
+  @brief    calculate the organized point cloud of a job's scan
+  @param    job         job with scan and calibration
+  @param    organized   receives all samples in scan layout, see lastPointCloud()
+  @return   false if canceled
+
+  With a complete calibration (see LaserTriangulator) camera rays are intersected with the laser plane;
+  otherwise the linear scale/offset mapping is used.
+  **/
+bool ExportWorker::triangulate(ExportJob *job, cv::Mat *organized)
+{
+    const ScanGrid &scan = job->scan;
+    if (scan.isEmpty())
+        return true;
+    const int firstRow = scan.firstRow();
+    const int rows = scan.rows();
+    const bool calibrated = job->triangulator.prepare(job->roiLine);
+    const int columns = calibrated ? qMin(scan.columns(), job->triangulator.roi().height()) : scan.columns();
+    if (!calibrated) {
+        DEBUG(10, "No calibration, using linear triangulation");
+    }
+
+    organized->create(rows, scan.columns(), CV_64FC3);
+    int reported = -1;
+    for (int y = 0; y < rows; y++) {
+        if (y % EXPORT_PROGRESS_ROWS == 0) {
+            if (canceled())
+                return false;
+            int percent = int(100LL * y / rows);
+            if (percent != reported) {
+                emit jobProgress(job->id, percent);
+                reported = percent;
+            }
+        }
+        double *data = organized->ptr<double>(y);
+        int row = y + firstRow;     //slider position
+        for (int x = 0; x < scan.columns(); x++, data += 3) {
+            bool valid = scan.isValid(row, x);
+            double z = valid ? scan.height(row, x) : 0.;
+            float p[3];
+            bool ok;
+            if (!calibrated) {  //linear "triangulation"
+                ok = (z != 0);
+                p[0] = float(((double)x - job->offset[0]) / job->scale[0]);
+                p[1] = float(((double)row - job->offset[1]) / job->scale[1]);
+                p[2] = float(((double)z - job->offset[2]) / (-job->scale[2]));
+            } else {
+                ok = valid && x < columns && job->triangulator.triangulate(x, z, row, p);
+            }
+            if (ok) {
+                data[0] = p[0];
+                data[1] = p[1];
+                data[2] = p[2];
+            } else {
+                data[0] = data[1] = data[2] = std::numeric_limits<double>::quiet_NaN();
+            }
+        }
+    }
+    emit jobProgress(job->id, 100);
+    return true;
+}
+
+/**
+  @brief    collect the valid samples of an organized cloud, row by row
+  @param    organized   64 bit x, y, z per sample, NaN if invalid
+  @param    normals     32 bit normals in the same layout, NaN if unknown; empty for none
+  @param    cloud       receives the points; has normals if normals is given, (0,0,0) where unknown
+  **/
+void ExportWorker::gather(const cv::Mat &organized, const cv::Mat &normals, PointCloud *cloud)
+{
+    static const float noNormal[3] = {0.0f, 0.0f, 0.0f};
+    const bool withNormals = !normals.empty();
+    cloud->setHasNormals(withNormals);
+    cloud->reserve(size_t(organized.rows) * organized.cols);
+    for (int y = 0; y < organized.rows; y++) {
+        const double *data = organized.ptr<double>(y);
+        const float *n = withNormals ? normals.ptr<float>(y) : NULL;
+        for (int x = 0; x < organized.cols; x++, data += 3) {
+            if (data[0] != data[0])     //NaN: no point
+                continue;
+            float p[3] = {float(data[0]), float(data[1]), float(data[2])};
+            if (withNormals)
+                cloud->append(p, (n[3 * x] == n[3 * x]) ? n + 3 * x : noNormal);
+            else
+                cloud->append(p);
+        }
+    }
+}
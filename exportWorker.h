@@ -0,0 +1,105 @@
+#ifndef EXPORTWORKER_H
+#define EXPORTWORKER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QList>
+#include <QRect>
+#include <opencv.hpp>
+#include "scanGrid.h"
+#include "triangulation.h"
+#include "pointCloud.h"
+#include "streamingCloud.h"
+#include "mesher.h"
+#include "decimation.h"
+
+#define EXPORT_PROGRESS_ROWS        64          ///< scan rows triangulated between progress reports and cancel checks
+#define EXPORT_WRITE_CHUNK          (1 << 20)   ///< points written between cancel checks
+
+
+/**
+  @struct   ExportJob   everything a point cloud export needs, independent of the live scanner state
+  **/
+struct ExportJob
+{
+    ExportJob() : id(-1), format(-1), openViewer(false), streamed(false), mesh(false), normals(true),
+                  maxEdge(MESHER_MAX_EDGE_DEFAULT), decimation(DECIMATE_NONE), stride(1), voxelSize(0.) {
+        scale[0] = scale[1] = scale[2] = 1.;
+        offset[0] = offset[1] = offset[2] = 0.;
+    }
+
+    int                 id;             ///< assigned by ExportWorker::enqueue
+    QString             fileName;       ///< output file
+    int                 format;         ///< CLOUD_FORMAT_*; -1 to choose by suffix
+    bool                openViewer;     ///< the requester wants to show the result
+    ScanGrid            scan;           ///< snapshot of the scan data, not touched by anyone else
+    LaserTriangulator   triangulator;   ///< calibration at the time of the request
+    QRect               roiLine;        ///< line roi the scan was taken with, see ScanGrid::lineRoi
+    double              scale[3];       ///< linear triangulation if not calibrated: scale x, y, z
+    double              offset[3];      ///< linear triangulation if not calibrated: offset x, y, z
+    bool                streamed;       ///< write the points of stream as they are instead of triangulating scan
+    StreamingCloudView  stream;         ///< points triangulated while digitizing
+    bool                mesh;           ///< write a triangle mesh of the scan grid instead of points; format is MESH_FORMAT_*
+    bool                normals;        ///< points: estimate and write normals
+    double              maxEdge;        ///< longest triangle edge / neighbour distance, see GridMesher::setMaxEdge
+    int                 decimation;     ///< DECIMATE_*, applied between triangulation and export
+    int                 stride;         ///< DECIMATE_STRIDE: keep every stride-th row and column
+    double              voxelSize;      ///< DECIMATE_VOXEL: voxel edge length in output units
+};
+
+
+/**
+  @class    ExportWorker    background thread triangulating and writing point clouds and meshes, one job after the other
+
+  Jobs are queued by enqueue() and processed in order at low priority, so neither the gui nor the capture
+  loop wait for an export. Each job owns its scan snapshot and calibration. Progress and results are
+  reported by signals, emitted from the worker thread.
+  **/
+class ExportWorker : public QThread
+{
+    Q_OBJECT
+public:
+    explicit ExportWorker(QObject *parent = 0);
+    virtual ~ExportWorker();
+
+    int         enqueue(ExportJob *job);
+    void        cancel(int id);
+    void        cancelAll();
+    int         pendingJobs();
+    cv::Mat     lastPointCloud();
+    cv::Mat     lastNormals();
+
+protected:
+    void run();
+
+signals:
+    void jobStarted(int id);
+    void jobProgress(int id, int percent);
+    void jobFinished(int id, const QString &fileName, bool success);
+    void jobCanceled(int id);
+
+public slots:
+    void sendTerminationRequest();
+
+private:
+    bool        process(ExportJob *job);
+    bool        triangulate(ExportJob *job, cv::Mat *organized);
+    void        gather(const cv::Mat &organized, const cv::Mat &normals, PointCloud *cloud);
+    bool        writeStream(ExportJob *job);
+    bool        writeMesh(ExportJob *job, const cv::Mat &organized, double maxEdge);
+    bool        canceled();
+
+private:
+    QMutex              m_mutex;                ///< guards all members below
+    QWaitCondition      m_jobsAvailable;        ///< signalled on enqueue and termination
+    QList<ExportJob*>   m_queue;                ///< jobs waiting; owned
+    int                 m_iNextId;              ///< id of the next job
+    int                 m_iCurrent;             ///< id of the running job, -1 if idle
+    bool                m_bCancelCurrent;       ///< running job shall stop
+    bool                m_bTerminationRequest;  ///< leave run() after the running job
+    cv::Mat             m_lastCloud;            ///< organized 64F3 points of the last finished job, NaN if invalid; strided if so decimated
+    cv::Mat             m_lastNormals;          ///< organized 32F3 normals of m_lastCloud
+};
+
+#endif // EXPORTWORKER_H
@@ -0,0 +1,97 @@
+#include "frameBufferPool.h"
+#include "QtException.h"
+
+FrameBufferPool::FrameBufferPool()
+{
+    for (int i = 0; i < POOL_IMAGE_COUNT; i++) {
+        m_images[i] = NULL;
+    }
+    m_points = NULL;
+    m_iPointCapacity = 0;
+    m_nAllocations = 0;
+    m_nBytes = 0;
+}
+
+/**
+  @brief    cleaning up destructor
+  **/
+FrameBufferPool::~FrameBufferPool()
+{
+    releaseAll();
+}
+
+/**
+  @brief    get working image
+  @param    id          one of POOL_*
+  @param    size        required size
+  @param    depth       required IPL_DEPTH_*
+  @param    channels    required number of channels
+  @return   image owned by the pool; content is whatever was left there by the last user
+
+  Only (re)allocates if the geometry differs from the buffer's current one.
+  **/
+IplImage* FrameBufferPool::image(int id, CvSize size, int depth, int channels)
+{
+    if (id < 0 || id >= POOL_IMAGE_COUNT) {
+        EX_THROW("Invalid buffer id");
+    }
+    IplImage *img = m_images[id];
+    if (img && img->width == size.width && img->height == size.height && img->depth == depth && img->nChannels == channels) {
+        return img;
+    }
+    if (img)
+        cvReleaseImage(&m_images[id]);
+    img = cvCreateImage(size, depth, channels);
+    m_images[id] = img;
+    ++m_nAllocations;
+    m_nBytes += img->imageSize;
+    DEBUG(20, QString("Buffer %1 (re)allocated: %2x%3x%4").arg(id).arg(size.width).arg(size.height).arg(channels));
+    return img;
+}
+
+/**
+  @brief    get point list buffer
+  @param    count   minimum number of points
+  @return   buffer owned by the pool
+  **/
+CvPoint2D32f* FrameBufferPool::points(int count)
+{
+    if (count > m_iPointCapacity) {
+        delete [] m_points;
+        m_points = new CvPoint2D32f[count];
+        m_iPointCapacity = count;
+        ++m_nAllocations;
+        m_nBytes += count * sizeof(CvPoint2D32f);
+    }
+    return m_points;
+}
+
+/**
+  @brief    free all buffers; statistics are kept
+  **/
+void FrameBufferPool::releaseAll()
+{
+    for (int i = 0; i < POOL_IMAGE_COUNT; i++) {
+        if (m_images[i])
+            cvReleaseImage(&m_images[i]);
+    }
+    delete [] m_points;
+    m_points = NULL;
+    m_iPointCapacity = 0;
+}
+
+/**
+  @brief    statistics: number of buffer (re)allocations since construction
+  **/
+quint64 FrameBufferPool::allocations()
+{
+    return m_nAllocations;
+}
+
+/**
+  @brief    statistics: total bytes (re)allocated since construction
+  **/
+quint64 FrameBufferPool::bytesAllocated()
+{
+    return m_nBytes;
+}
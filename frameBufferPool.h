@@ -0,0 +1,47 @@
+#ifndef FRAMEBUFFERPOOL_H
+#define FRAMEBUFFERPOOL_H
+
+#include <opencv.hpp>
+
+//buffer ids of the per frame working images
+#define POOL_GRAY           0       ///< 8 bit gray of preprocessed image (display only)
+#define POOL_GRAYF32        1       ///< float laser intensity
+#define POOL_POINT          2       ///< float point roi copy
+#define POOL_LINE           3       ///< float line roi copy
+#define POOL_CHESSBOARD     4       ///< 8 bit gray for chessboard corner refinement
+#define POOL_POINT_COARSE   5       ///< float decimated point roi
+#define POOL_POINT_FINE     6       ///< float full resolution window around the coarse point
+#define POOL_DEBUG          7       ///< 8 bit bgr debug image when the display is downscaled
+#define POOL_IMAGE_COUNT    8       ///< number of image buffers; extend above when adding ids
+
+/**
+  @class    FrameBufferPool     persistent working buffers of the processing loop
+
+  Each id holds one image which is kept across frames and only reallocated if the requested
+  geometry differs from the last request. Once resolution and rois are fixed the processing loop
+  doesn't allocate anything; allocations() proves it.
+
+  Not thread safe; meant to be owned by one processing thread.
+  **/
+class FrameBufferPool
+{
+public:
+    FrameBufferPool();
+    virtual ~FrameBufferPool();
+
+    IplImage*       image(int id, CvSize size, int depth, int channels);
+    CvPoint2D32f*   points(int count);
+    void            releaseAll();
+
+    quint64         allocations();
+    quint64         bytesAllocated();
+
+private:
+    IplImage*       m_images[POOL_IMAGE_COUNT];     ///< buffers by id
+    CvPoint2D32f*   m_points;                       ///< point list buffer
+    int             m_iPointCapacity;               ///< size of m_points
+    quint64         m_nAllocations;                 ///< statistics: number of (re)allocations
+    quint64         m_nBytes;                       ///< statistics: bytes (re)allocated in total
+};
+
+#endif // FRAMEBUFFERPOOL_H
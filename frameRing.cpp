@@ -0,0 +1,259 @@
+#include "frameRing.h"
+#include "QtException.h"
+
+FrameRing::FrameRing(int capacity, int policy)
+{
+    if (capacity < 1) {
+        DEBUG(1, "Warning: frame ring capacity must be positive, using 1");
+        capacity = 1;
+    }
+    m_iCapacity = capacity;
+    m_iPolicy = policy;
+    m_iLateMs = FRAMERING_LATE_MS;
+    m_bAbort = false;
+
+    m_slots = new IplImage*[m_iCapacity];
+    m_stamps = new qint64[m_iCapacity];
+    m_sequence = new quint64[m_iCapacity];
+    for (int i = 0; i < m_iCapacity; i++) {
+        m_slots[i] = NULL;
+        m_stamps[i] = 0;
+        m_sequence[i] = 0;
+    }
+    m_reader = NULL;
+    m_iHead = 0;
+    m_iCount = 0;
+
+    m_nCaptured = 0;
+    m_nDropped = 0;
+    m_nLate = 0;
+
+    m_clock.start();
+}
+
+/**
+  @brief    cleaning up destructor
+  **/
+FrameRing::~FrameRing()
+{
+    abort();
+    release();
+    if (m_reader)
+        cvReleaseImage(&m_reader);
+    delete [] m_slots;
+    delete [] m_stamps;
+    delete [] m_sequence;
+}
+
+/**
+  @brief    set behaviour for a full ring
+  @param    policy  FRAMERING_DROP_OLDEST or FRAMERING_BLOCK
+  **/
+void FrameRing::setOverflowPolicy(int policy)
+{
+    QMutexLocker lock(&m_mutex);
+    m_iPolicy = policy;
+    m_notFull.wakeAll();    //a blocked producer must re-evaluate
+}
+
+/**
+  @brief    get behaviour for a full ring
+  @return   FRAMERING_DROP_OLDEST or FRAMERING_BLOCK
+  **/
+int FrameRing::overflowPolicy()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_iPolicy;
+}
+
+/**
+  @brief    set age above which a frame is counted late when it reaches the consumer
+  @param    ms  age in milliseconds
+  **/
+void FrameRing::setLateThreshold(int ms)
+{
+    QMutexLocker lock(&m_mutex);
+    m_iLateMs = ms;
+}
+
+/**
+  @brief    get number of slots
+  **/
+int FrameRing::capacity()
+{
+    return m_iCapacity;
+}
+
+/**
+  @brief    (re)allocate all slots for the geometry of frame
+
+  must be called with m_mutex locked and the ring empty. The consumer's buffer is left alone,
+  it may still be in use; pop() replaces it once it comes back.
+  **/
+void FrameRing::allocate(const IplImage *frame)
+{
+    release();
+    for (int i = 0; i < m_iCapacity; i++) {
+        m_slots[i] = cvCreateImage(cvGetSize(frame), frame->depth, frame->nChannels);
+    }
+    DEBUG(10, QString("Allocated frame ring %1 x (%2x%3x%4)").arg(m_iCapacity).arg(frame->width).arg(frame->height).arg(frame->nChannels));
+}
+
+/**
+  @brief    free all slot buffers
+  **/
+void FrameRing::release()
+{
+    for (int i = 0; i < m_iCapacity; i++) {
+        if (m_slots[i])
+            cvReleaseImage(&m_slots[i]);
+    }
+}
+
+/**
+  @brief    copy a captured frame into the ring
+  @param    frame   image to enqueue; is copied, caller keeps ownership
+  @return   false if the frame was not enqueued (ring aborted)
+
+  If the ring is full either the oldest queued frame is dropped or the call waits for the consumer,
+  depending on the overflow policy.
+  **/
+bool FrameRing::push(const IplImage *frame)
+{
+    QMutexLocker lock(&m_mutex);
+    if (m_bAbort)
+        return false;
+
+    IplImage *slot = m_slots[0];
+    if (!slot || slot->width != frame->width || slot->height != frame->height
+            || slot->depth != frame->depth || slot->nChannels != frame->nChannels) {
+        //geometry changed: queued frames are of no use any more
+        m_nDropped += m_iCount;
+        m_iCount = 0;
+        m_iHead = 0;
+        allocate(frame);
+    }
+
+    while (m_iCount == m_iCapacity) {
+        if (m_iPolicy == FRAMERING_BLOCK) {
+            m_notFull.wait(&m_mutex);
+            if (m_bAbort)
+                return false;
+        } else {    //drop the oldest one
+            m_iHead = (m_iHead + 1) % m_iCapacity;
+            --m_iCount;
+            ++m_nDropped;
+        }
+    }
+
+    int idx = (m_iHead + m_iCount) % m_iCapacity;
+    cvCopy(frame, m_slots[idx]);
+    m_stamps[idx] = m_clock.elapsed();
+    m_sequence[idx] = m_nCaptured++;
+    ++m_iCount;
+    m_notEmpty.wakeOne();
+    return true;
+}
+
+/**
+  @brief    take the oldest frame from the ring
+  @param    timeoutMs   maximum time to wait for a frame
+  @param    sequence    optional output: capture sequence number of the frame
+  @return   frame buffer owned by the ring, valid until the next call to pop; NULL on timeout or abort
+  **/
+IplImage* FrameRing::pop(int timeoutMs, quint64 *sequence /*= NULL*/)
+{
+    QMutexLocker lock(&m_mutex);
+    while (m_iCount == 0) {
+        if (m_bAbort)
+            return NULL;
+        if (!m_notEmpty.wait(&m_mutex, timeoutMs))
+            return NULL;
+    }
+    if (m_bAbort)
+        return NULL;
+
+    //swap consumer's buffer with the queued one; the old consumer buffer becomes a free slot
+    IplImage *spare = m_reader;
+    m_reader = m_slots[m_iHead];
+    if (!spare || spare->width != m_reader->width || spare->height != m_reader->height
+            || spare->depth != m_reader->depth || spare->nChannels != m_reader->nChannels) {
+        if (spare)
+            cvReleaseImage(&spare);
+        spare = cvCreateImage(cvGetSize(m_reader), m_reader->depth, m_reader->nChannels);
+    }
+    m_slots[m_iHead] = spare;
+
+    if (m_clock.elapsed() - m_stamps[m_iHead] > m_iLateMs)
+        ++m_nLate;
+    if (sequence)
+        *sequence = m_sequence[m_iHead];
+
+    m_iHead = (m_iHead + 1) % m_iCapacity;
+    --m_iCount;
+    m_notFull.wakeOne();
+    return m_reader;
+}
+
+/**
+  @brief    discard all queued frames
+  **/
+void FrameRing::clear()
+{
+    QMutexLocker lock(&m_mutex);
+    m_iHead = 0;
+    m_iCount = 0;
+    m_notFull.wakeAll();
+}
+
+/**
+  @brief    wake up all waiting threads and refuse further frames until reset()
+  **/
+void FrameRing::abort()
+{
+    QMutexLocker lock(&m_mutex);
+    m_bAbort = true;
+    m_notEmpty.wakeAll();
+    m_notFull.wakeAll();
+}
+
+/**
+  @brief    make an aborted ring usable again; statistics are cleared
+  **/
+void FrameRing::reset()
+{
+    QMutexLocker lock(&m_mutex);
+    m_bAbort = false;
+    m_iHead = 0;
+    m_iCount = 0;
+    m_nCaptured = 0;
+    m_nDropped = 0;
+    m_nLate = 0;
+}
+
+/**
+  @brief    statistics: number of frames pushed since last reset
+  **/
+quint64 FrameRing::framesCaptured()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_nCaptured;
+}
+
+/**
+  @brief    statistics: number of frames dropped since last reset
+  **/
+quint64 FrameRing::framesDropped()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_nDropped;
+}
+
+/**
+  @brief    statistics: number of frames that were older than the late threshold when popped
+  **/
+quint64 FrameRing::framesLate()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_nLate;
+}
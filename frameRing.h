@@ -0,0 +1,75 @@
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <opencv.hpp>
+
+#define FRAMERING_DEFAULT_CAPACITY  4       ///< default number of preallocated frame slots
+#define FRAMERING_LATE_MS           100     ///< default age in ms beyond which a consumed frame counts as late
+
+//overflow policies: what to do when the consumer can't keep up
+#define FRAMERING_DROP_OLDEST       0       ///< overwrite the oldest unprocessed frame, capture never waits
+#define FRAMERING_BLOCK             1       ///< capture waits until the consumer has freed a slot
+
+
+/**
+  @class    FrameRing   fixed size ring of preallocated frame buffers between capture and processing
+
+  The capturing side copies each camera frame into the next free slot (push), the processing side
+  takes the oldest frame (pop). The consumer owns one extra spare buffer: pop swaps the buffer pointers
+  so the frame handed out is never touched by the capturing side until the next pop, no pixel is copied twice.
+
+  Buffers are allocated once for the first frame's geometry and only reallocated if the geometry changes.
+  **/
+class FrameRing
+{
+public:
+    explicit FrameRing(int capacity = FRAMERING_DEFAULT_CAPACITY, int policy = FRAMERING_DROP_OLDEST);
+    virtual ~FrameRing();
+
+    void        setOverflowPolicy(int policy);
+    int         overflowPolicy();
+    void        setLateThreshold(int ms);
+    int         capacity();
+
+    bool        push(const IplImage *frame);
+    IplImage*   pop(int timeoutMs, quint64 *sequence = NULL);
+    void        clear();
+    void        abort();
+    void        reset();
+
+    quint64     framesCaptured();
+    quint64     framesDropped();
+    quint64     framesLate();
+
+private:
+    void        allocate(const IplImage *frame);
+    void        release();
+
+private:
+    QMutex          m_mutex;                ///< guards all members below
+    QWaitCondition  m_notEmpty;             ///< signalled when a frame was pushed
+    QWaitCondition  m_notFull;              ///< signalled when a slot was freed
+    QElapsedTimer   m_clock;                ///< time base for frame stamps
+
+    int             m_iCapacity;            ///< number of slots
+    int             m_iPolicy;              ///< overflow policy FRAMERING_DROP_OLDEST or FRAMERING_BLOCK
+    int             m_iLateMs;              ///< age threshold for late frames
+    bool            m_bAbort;               ///< wake up and leave any waiting call
+
+    IplImage**      m_slots;                ///< preallocated frame buffers
+    qint64*         m_stamps;               ///< capture time stamp of each slot (ms)
+    quint64*        m_sequence;             ///< capture sequence number of each slot
+    int             m_iHead;                ///< index of oldest queued frame
+    int             m_iCount;               ///< number of queued frames
+
+    IplImage*       m_reader;               ///< buffer currently owned by the consumer
+
+    quint64         m_nCaptured;            ///< statistics: frames pushed
+    quint64         m_nDropped;             ///< statistics: frames overwritten before being processed
+    quint64         m_nLate;                ///< statistics: frames older than m_iLateMs when popped
+};
+
+#endif // FRAMERING_H
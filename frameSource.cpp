@@ -0,0 +1,377 @@
+#include "frameSource.h"
+#include "QtException.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QDataStream>
+#include <string.h>
+
+/**
+  @brief    bytes per channel of an ipl depth
+  **/
+static int iplBytesPerChannel(int depth)
+{
+    return (depth & 255) / 8;
+}
+
+/************************************** FrameSource **************************************/
+
+FrameSource::FrameSource()
+{
+}
+
+FrameSource::~FrameSource()
+{
+}
+
+/**
+  @brief    true for cameras: frames come at their own pace and can't be replayed
+  **/
+bool FrameSource::isLive()
+{
+    return false;
+}
+
+/**
+  @brief    start over at the first frame
+  @return   false if not supported
+  **/
+bool FrameSource::rewind()
+{
+    return false;
+}
+
+/**
+  @brief    nominal frame rate in frames per second
+  **/
+double FrameSource::frameRate()
+{
+    return FRAMESOURCE_DEFAULT_FPS;
+}
+
+/**
+  @brief    create a replay source matching path
+  @param    path    directory (PNG sequence), *.raw (raw frame dump) or anything else (video file)
+  @return   new source owned by the caller; NULL if it can't be opened
+  **/
+FrameSource* FrameSource::createFromPath(const QString &path)
+{
+    QFileInfo info(path);
+    FrameSource *src;
+    if (info.isDir()) {
+        src = new ImageSequenceFrameSource(path);
+    } else if (0 == info.suffix().compare("raw", Qt::CaseInsensitive)) {
+        src = new RawDumpFrameSource(path);
+    } else {
+        src = new VideoFileFrameSource(path);
+    }
+    if (!src->isOpen()) {
+        DEBUG(1, QString("Could not open frame source %1").arg(path));
+        delete src;
+        return NULL;
+    }
+    return src;
+}
+
+/************************************** CameraFrameSource **************************************/
+
+CameraFrameSource::CameraFrameSource(CvCapture *cvCapture, int cvIndex /*= -1*/)
+{
+    m_cvCapture = cvCapture;
+    m_iCamera = cvIndex;
+}
+
+const IplImage* CameraFrameSource::grab()
+{
+    if (!m_cvCapture)
+        return NULL;
+    return cvQueryFrame(m_cvCapture);   //owned by the capture struct
+}
+
+bool CameraFrameSource::isOpen()
+{
+    return m_cvCapture != NULL;
+}
+
+bool CameraFrameSource::isLive()
+{
+    return true;
+}
+
+double CameraFrameSource::frameRate()
+{
+    double fps = m_cvCapture ? cvGetCaptureProperty(m_cvCapture, CV_CAP_PROP_FPS) : 0.0;
+    return (fps > 0.0) ? fps : FRAMESOURCE_DEFAULT_FPS;
+}
+
+QString CameraFrameSource::description()
+{
+    return QString("cv: %1").arg(m_iCamera);
+}
+
+/************************************** VideoFileFrameSource **************************************/
+
+VideoFileFrameSource::VideoFileFrameSource(const QString &fileName)
+{
+    m_fileName = fileName;
+    m_cvCapture = cvCaptureFromFile(fileName.toLocal8Bit().constData());
+}
+
+VideoFileFrameSource::~VideoFileFrameSource()
+{
+    if (m_cvCapture)
+        cvReleaseCapture(&m_cvCapture);
+}
+
+const IplImage* VideoFileFrameSource::grab()
+{
+    if (!m_cvCapture)
+        return NULL;
+    return cvQueryFrame(m_cvCapture);
+}
+
+bool VideoFileFrameSource::isOpen()
+{
+    return m_cvCapture != NULL;
+}
+
+bool VideoFileFrameSource::rewind()
+{
+    if (!m_cvCapture)
+        return false;
+    return cvSetCaptureProperty(m_cvCapture, CV_CAP_PROP_POS_FRAMES, 0) != 0;
+}
+
+double VideoFileFrameSource::frameRate()
+{
+    double fps = m_cvCapture ? cvGetCaptureProperty(m_cvCapture, CV_CAP_PROP_FPS) : 0.0;
+    return (fps > 0.0) ? fps : FRAMESOURCE_DEFAULT_FPS;
+}
+
+QString VideoFileFrameSource::description()
+{
+    return QString("file: %1").arg(m_fileName);
+}
+
+/************************************** ImageSequenceFrameSource **************************************/
+
+ImageSequenceFrameSource::ImageSequenceFrameSource(const QString &dirName, double fps /*= FRAMESOURCE_DEFAULT_FPS*/)
+{
+    m_dirName = dirName;
+    m_dFps = fps;
+    m_iNext = 0;
+    m_frame = NULL;
+
+    QDir dir(dirName);
+    QStringList names = dir.entryList(QStringList() << "*.png" << "*.PNG", QDir::Files, QDir::Name);
+    for (int i = 0; i < names.count(); i++) {
+        m_files.append(dir.absoluteFilePath(names.at(i)));
+    }
+}
+
+ImageSequenceFrameSource::~ImageSequenceFrameSource()
+{
+    if (m_frame)
+        cvReleaseImage(&m_frame);
+}
+
+const IplImage* ImageSequenceFrameSource::grab()
+{
+    if (m_iNext >= m_files.count())
+        return NULL;
+    if (m_frame)
+        cvReleaseImage(&m_frame);
+    m_frame = cvLoadImage(m_files.at(m_iNext).toLocal8Bit().constData(), CV_LOAD_IMAGE_COLOR);    //processing expects bgr like the camera delivers
+    if (!m_frame) {
+        DEBUG(10, QString("Could not load %1").arg(m_files.at(m_iNext)));
+    }
+    ++m_iNext;
+    return m_frame;
+}
+
+bool ImageSequenceFrameSource::isOpen()
+{
+    return m_files.count() > 0;
+}
+
+bool ImageSequenceFrameSource::rewind()
+{
+    m_iNext = 0;
+    return true;
+}
+
+double ImageSequenceFrameSource::frameRate()
+{
+    return m_dFps;
+}
+
+/**
+  @brief    set nominal frame rate for realtime replay; pngs don't know their own
+  **/
+void ImageSequenceFrameSource::setFrameRate(double fps)
+{
+    if (fps <= 0.0) {
+        DEBUG(1, "Warning: nonpositive frame rate!");
+        return;
+    }
+    m_dFps = fps;
+}
+
+QString ImageSequenceFrameSource::description()
+{
+    return QString("file: %1").arg(m_dirName);
+}
+
+/************************************** RawDumpFrameSource **************************************/
+
+RawDumpFrameSource::RawDumpFrameSource(const QString &fileName)
+{
+    m_frame = NULL;
+    m_iDataStart = 0;
+    m_dFps = FRAMESOURCE_DEFAULT_FPS;
+
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        DEBUG(1, QString("Could not open raw dump %1").arg(fileName));
+        return;
+    }
+
+    char magic[RAWDUMP_MAGIC_LENGTH];
+    QDataStream in(&m_file);
+    in.setByteOrder(QDataStream::LittleEndian);
+    in.setFloatingPointPrecision(QDataStream::DoublePrecision);
+    qint32 width, height, depth, channels;
+    if (in.readRawData(magic, RAWDUMP_MAGIC_LENGTH) != RAWDUMP_MAGIC_LENGTH
+            || 0 != memcmp(magic, RAWDUMP_MAGIC, RAWDUMP_MAGIC_LENGTH)) {
+        DEBUG(1, QString("%1 is no raw frame dump").arg(fileName));
+        m_file.close();
+        return;
+    }
+    in >> width >> height >> depth >> channels >> m_dFps;
+    if (in.status() != QDataStream::Ok || width < 1 || height < 1 || channels < 1 || iplBytesPerChannel(depth) < 1) {
+        DEBUG(1, QString("Corrupt raw dump header in %1").arg(fileName));
+        m_file.close();
+        return;
+    }
+    m_iDataStart = m_file.pos();
+    m_frame = cvCreateImage(cvSize(width, height), depth, channels);
+}
+
+RawDumpFrameSource::~RawDumpFrameSource()
+{
+    if (m_frame)
+        cvReleaseImage(&m_frame);
+}
+
+const IplImage* RawDumpFrameSource::grab()
+{
+    if (!m_frame)
+        return NULL;
+    //frames are tightly packed in the file; image rows may be padded
+    qint64 rowBytes = qint64(m_frame->width) * m_frame->nChannels * iplBytesPerChannel(m_frame->depth);
+    for (int y = 0; y < m_frame->height; y++) {
+        if (m_file.read(m_frame->imageData + y * m_frame->widthStep, rowBytes) != rowBytes)
+            return NULL;    //end of dump
+    }
+    return m_frame;
+}
+
+bool RawDumpFrameSource::isOpen()
+{
+    return m_frame != NULL;
+}
+
+bool RawDumpFrameSource::rewind()
+{
+    return m_frame && m_file.seek(m_iDataStart);
+}
+
+double RawDumpFrameSource::frameRate()
+{
+    return (m_dFps > 0.0) ? m_dFps : FRAMESOURCE_DEFAULT_FPS;
+}
+
+QString RawDumpFrameSource::description()
+{
+    return QString("file: %1").arg(m_file.fileName());
+}
+
+/************************************** RawDumpWriter **************************************/
+
+RawDumpWriter::RawDumpWriter()
+{
+    m_dFps = FRAMESOURCE_DEFAULT_FPS;
+    m_bHeaderWritten = false;
+    m_iWidth = 0;
+    m_iHeight = 0;
+    m_iDepth = 0;
+    m_iChannels = 0;
+}
+
+RawDumpWriter::~RawDumpWriter()
+{
+    close();
+}
+
+/**
+  @brief    start a new dump
+  @param    fileName    file to (over)write
+  @param    fps         frame rate to note for realtime replay
+  **/
+bool RawDumpWriter::open(const QString &fileName, double fps)
+{
+    close();
+    m_file.setFileName(fileName);
+    m_dFps = fps;
+    m_bHeaderWritten = false;
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        DEBUG(1, QString("Could not open %1 for writing").arg(fileName));
+        return false;
+    }
+    return true;
+}
+
+/**
+  @brief    append one frame; all frames must have the geometry of the first one
+  **/
+bool RawDumpWriter::write(const IplImage *frame)
+{
+    if (!m_file.isOpen() || !frame)
+        return false;
+    if (!m_bHeaderWritten) {
+        m_iWidth = frame->width;
+        m_iHeight = frame->height;
+        m_iDepth = frame->depth;
+        m_iChannels = frame->nChannels;
+
+        QDataStream out(&m_file);
+        out.setByteOrder(QDataStream::LittleEndian);
+        out.setFloatingPointPrecision(QDataStream::DoublePrecision);
+        out.writeRawData(RAWDUMP_MAGIC, RAWDUMP_MAGIC_LENGTH);
+        out << qint32(m_iWidth) << qint32(m_iHeight) << qint32(m_iDepth) << qint32(m_iChannels) << m_dFps;
+        m_bHeaderWritten = true;
+    }
+    if (frame->width != m_iWidth || frame->height != m_iHeight || frame->depth != m_iDepth || frame->nChannels != m_iChannels) {
+        DEBUG(10, "Frame geometry changed while dumping; frame skipped");
+        return false;
+    }
+    qint64 rowBytes = qint64(frame->width) * frame->nChannels * iplBytesPerChannel(frame->depth);
+    for (int y = 0; y < frame->height; y++) {
+        if (m_file.write(frame->imageData + y * frame->widthStep, rowBytes) != rowBytes)
+            return false;
+    }
+    return true;
+}
+
+/**
+  @brief    finish the dump
+  **/
+void RawDumpWriter::close()
+{
+    if (m_file.isOpen())
+        m_file.close();
+}
+
+bool RawDumpWriter::isOpen()
+{
+    return m_file.isOpen();
+}
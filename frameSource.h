@@ -0,0 +1,161 @@
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include <QString>
+#include <QStringList>
+#include <QFile>
+#include <opencv.hpp>
+
+#define FRAMESOURCE_DEFAULT_FPS     30.0        ///< frame rate assumed if the source doesn't know its own
+
+//replay modes for recorded sources
+#define REPLAY_REALTIME             0           ///< deliver frames at the recorded frame rate
+#define REPLAY_FAST                 1           ///< deliver frames as fast as they can be processed
+
+#define RAWDUMP_MAGIC               "CLSRAW01"  ///< file signature of raw frame dumps
+#define RAWDUMP_MAGIC_LENGTH        8
+
+
+/**
+  @class    FrameSource     abstract provider of camera frames
+
+  Everything the capture thread grabs from comes through here: a live camera or a recording
+  of one. Recordings make camera-free, deterministic runs (benchmarks, field problem reproduction) possible.
+  **/
+class FrameSource
+{
+public:
+    FrameSource();
+    virtual ~FrameSource();
+
+    /** @brief  next frame, owned by the source and valid until the next grab; NULL at end of stream or on error **/
+    virtual const IplImage* grab() = 0;
+    /** @brief  true if the source could be opened **/
+    virtual bool    isOpen() = 0;
+    /** @brief  true for cameras: frames come at their own pace and can't be replayed **/
+    virtual bool    isLive();
+    /** @brief  start over at the first frame, if possible **/
+    virtual bool    rewind();
+    virtual double  frameRate();
+    virtual QString description() = 0;
+
+    static FrameSource* createFromPath(const QString &path);
+};
+
+
+/**
+  @class    CameraFrameSource   live opencv camera
+  **/
+class CameraFrameSource : public FrameSource
+{
+public:
+    explicit CameraFrameSource(CvCapture *cvCapture, int cvIndex = -1);
+
+    virtual const IplImage* grab();
+    virtual bool    isOpen();
+    virtual bool    isLive();
+    virtual double  frameRate();
+    virtual QString description();
+
+private:
+    CvCapture*  m_cvCapture;    ///< capture device; owned by the caller
+    int         m_iCamera;      ///< camera id
+};
+
+
+/**
+  @class    VideoFileFrameSource    any video file opencv can decode
+  **/
+class VideoFileFrameSource : public FrameSource
+{
+public:
+    explicit VideoFileFrameSource(const QString &fileName);
+    virtual ~VideoFileFrameSource();
+
+    virtual const IplImage* grab();
+    virtual bool    isOpen();
+    virtual bool    rewind();
+    virtual double  frameRate();
+    virtual QString description();
+
+private:
+    QString     m_fileName;     ///< video file
+    CvCapture*  m_cvCapture;    ///< decoder
+};
+
+
+/**
+  @class    ImageSequenceFrameSource    directory of PNG frames, replayed in file name order
+  **/
+class ImageSequenceFrameSource : public FrameSource
+{
+public:
+    explicit ImageSequenceFrameSource(const QString &dirName, double fps = FRAMESOURCE_DEFAULT_FPS);
+    virtual ~ImageSequenceFrameSource();
+
+    virtual const IplImage* grab();
+    virtual bool    isOpen();
+    virtual bool    rewind();
+    virtual double  frameRate();
+    virtual QString description();
+    void            setFrameRate(double fps);
+
+private:
+    QString     m_dirName;      ///< directory
+    QStringList m_files;        ///< sorted absolute file names
+    int         m_iNext;        ///< index of next file to load
+    double      m_dFps;         ///< nominal frame rate
+    IplImage*   m_frame;        ///< last loaded frame
+};
+
+
+/**
+  @class    RawDumpFrameSource  raw binary frame dump as written by RawDumpWriter
+
+  File layout: RAWDUMP_MAGIC, int32 width, height, depth, channels, double fps, then tightly packed frames
+  **/
+class RawDumpFrameSource : public FrameSource
+{
+public:
+    explicit RawDumpFrameSource(const QString &fileName);
+    virtual ~RawDumpFrameSource();
+
+    virtual const IplImage* grab();
+    virtual bool    isOpen();
+    virtual bool    rewind();
+    virtual double  frameRate();
+    virtual QString description();
+
+private:
+    QFile       m_file;         ///< dump file
+    qint64      m_iDataStart;   ///< file offset of first frame
+    double      m_dFps;         ///< recorded frame rate
+    IplImage*   m_frame;        ///< frame buffer
+};
+
+
+/**
+  @class    RawDumpWriter   write frames into a raw binary dump for later replay
+  **/
+class RawDumpWriter
+{
+public:
+    RawDumpWriter();
+    virtual ~RawDumpWriter();
+
+    bool    open(const QString &fileName, double fps);
+    bool    write(const IplImage *frame);
+    void    close();
+    bool    isOpen();
+
+private:
+    QFile   m_file;             ///< dump file
+    double  m_dFps;             ///< frame rate to note in header
+    bool    m_bHeaderWritten;   ///< header is written with the first frame's geometry
+    int     m_iWidth;           ///< geometry of first frame
+    int     m_iHeight;          ///< geometry of first frame
+    int     m_iDepth;           ///< geometry of first frame
+    int     m_iChannels;        ///< geometry of first frame
+};
+
+#endif // FRAMESOURCE_H
@@ -1,7 +1,9 @@
 #include "heightmapwidget.h"
 #include "QtException.h"
 #include <QPainter>
+#include <QPaintEvent>
 #include <stdint.h>
+#include <math.h>
 
 #ifndef UINT8
     typedef unsigned char UINT8;
@@ -16,6 +18,10 @@ HeightmapWidget::HeightmapWidget(QWidget *parent) :
 {
     m_scaleX = 0.0;
     m_scaleY = 0.0;
+    m_iGridTiles = -1;
+    m_iGridFirstRow = 0;
+    m_iGridGeneration = 0;
+    m_iGridEpoch = 0;
 }
 
 
@@ -26,6 +32,7 @@ HeightmapWidget::HeightmapWidget(QWidget *parent) :
 void HeightmapWidget::setImage(const QImage &img)
 {
     m_image = img;
+    m_iGridTiles = -1;
     update();   //schedule paint event
 }
 
@@ -39,6 +46,7 @@ void HeightmapWidget::setImage(const IplImage *img)
         DEBUG(10, "Image is NULL");
         return;
       }
+      m_iGridTiles = -1;
       if ( (img->height != m_image.height()) || (img->width != m_image.width()) ) {	//check for image sizes
           m_image = QImage(img->width, img->height, QImage::Format_RGB32);
           m_image.fill( 0x000000ff);
@@ -111,6 +119,101 @@ void HeightmapWidget::setImage(const IplImage *img)
       update();
 }
 
+/**
+  @brief    set image from scan data: height as gray value
+  @param    grid    scan data; rows become image rows, starting at the grid's first row
+
+  Only tiles changed since the last call are converted and repainted, as long as the grid keeps its extent
+  and hasn't been cleared in between (see ScanGrid::resetEpoch).
+  **/
+void HeightmapWidget::setScanGrid(const ScanGrid *grid)
+{
+    if (NULL == grid || grid->isEmpty()) {
+        DEBUG(10, "Scan grid is empty");
+        return;
+    }
+    int firstRow = grid->firstRow();
+    int tiles = grid->tileCount();
+    bool full = (m_iGridTiles < 0) || (firstRow != m_iGridFirstRow) || (tiles < m_iGridTiles)
+            || (grid->resetEpoch() != m_iGridEpoch);
+    if ( (grid->rows() != m_image.height()) || (grid->columns() != m_image.width()) ) {
+        m_image = QImage(grid->columns(), grid->rows(), QImage::Format_RGB32);
+        DEBUG(10, QString("Created m_image (%1x%2)").arg(m_image.width()).arg(m_image.height()));
+        full = true;
+    }
+    if (full) {     //extent changed or tiles were removed or cleared: start from black
+        m_image.fill(0);
+        m_iGridGeneration = 0;
+    }
+
+    std::vector<int> dirty;
+    grid->tilesChangedSince(m_iGridGeneration, dirty);
+    int dirtyFrom = grid->rows();   //image rows
+    int dirtyTo = -1;
+    UINT32 *pDstBase;
+    UINT8 r;
+    for (size_t i = 0; i < dirty.size(); i++) {
+        int from = qMax(ScanGrid::tileFirstRow(dirty[i]), firstRow);
+        int to = qMin(ScanGrid::tileFirstRow(dirty[i] + 1), grid->endRow());
+        for (int row = from; row < to; row++) {
+            pDstBase = (UINT32*) m_image.scanLine(row - firstRow);
+            for (int x = 0; x < grid->columns(); x++) {
+                r = (UINT8) grid->height(row, x);
+                *(pDstBase + x) = (((UINT32)(r)) << 16) | (((UINT32)(r)) << 8) | r;
+            }
+        }
+        if (from < to) {
+            dirtyFrom = qMin(dirtyFrom, from - firstRow);
+            dirtyTo = qMax(dirtyTo, to - firstRow);
+        }
+    }
+    m_iGridGeneration = grid->generation();
+    m_iGridFirstRow = firstRow;
+    m_iGridTiles = tiles;
+    m_iGridEpoch = grid->resetEpoch();
+
+    if (full || m_scaleX <= 0.0 || m_scaleY <= 0.0) {
+        update();
+    } else if (dirtyTo > dirtyFrom) {   //repaint the dirty rows' band of the widget only; +-1 for the smoothed scaling
+        int top = int(floor(dirtyFrom * m_scaleY)) - 1;
+        int bottom = int(ceil(dirtyTo * m_scaleY)) + 1;
+        update(QRect(0, top, width(), bottom - top));
+    }
+}
+
+/**
+  @brief    set image from conveyor scan data: height as gray value, newest row at the bottom
+  @param    map     rolling heightmap; all kept rows are shown
+  **/
+void HeightmapWidget::setRollingHeightmap(const RollingHeightmap *map)
+{
+    if (NULL == map || map->columns() == 0) {
+        DEBUG(10, "Rolling heightmap is empty");
+        return;
+    }
+    m_iGridTiles = -1;
+    if ( (map->capacity() != m_image.height()) || (map->columns() != m_image.width()) ) {
+        m_image = QImage(map->columns(), map->capacity(), QImage::Format_RGB32);
+        DEBUG(10, QString("Created m_image (%1x%2)").arg(m_image.width()).arg(m_image.height()));
+    }
+    m_image.fill(0);
+
+    RollingSegment segments[2];
+    qint64 first = map->newestPosition() - map->capacity() + 1;
+    int n = map->window(first, map->capacity(), segments);
+    for (int i = 0; i < n; i++) {
+        for (int r = 0; r < segments[i].rows; r++) {
+            UINT32 *pDstBase = (UINT32*) m_image.scanLine(int(segments[i].firstPosition - first) + r);
+            const float *height = segments[i].height + r * map->columns();
+            for (int x = 0; x < map->columns(); x++) {
+                UINT8 v = (UINT8) height[x];
+                *(pDstBase + x) = (((UINT32)(v)) << 16) | (((UINT32)(v)) << 8) | v;
+            }
+        }
+    }
+    update();
+}
+
 /**
   @brief    do all that needs to be done for displaying purposes
   **/
@@ -123,13 +226,19 @@ void HeightmapWidget::paintEvent(QPaintEvent *event)
 
         //draw image content first
 
-        //DEBUG(10,QString("Draw %1 %2 %3 %4").arg(this->rect().left()).arg(this->rect().top()).arg(this->rect().right()).arg(this->rect().bottom()));
-        painter.drawImage(this->rect(), m_image);
-
         //calculate current scale
         m_scaleX = float(this->rect().width()) / float(m_image.width());
         m_scaleY = float(this->rect().height()) / float(m_image.height());
 
+        //DEBUG(10,QString("Draw %1 %2 %3 %4").arg(this->rect().left()).arg(this->rect().top()).arg(this->rect().right()).arg(this->rect().bottom()));
+        if (event->rect() != this->rect()) {    //partial repaint: only scale the part of the image that is visible in it
+            QRectF target(event->rect());
+            QRectF source(target.left() / m_scaleX, target.top() / m_scaleY, target.width() / m_scaleX, target.height() / m_scaleY);
+            painter.drawImage(target, m_image, source);
+        } else {
+            painter.drawImage(this->rect(), m_image);
+        }
+
 
     } else {    //no content
         DEBUG(10, "Empty m_image");
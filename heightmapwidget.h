@@ -3,6 +3,8 @@
 
 #include <QWidget>
 #include <opencv.hpp>
+#include "scanGrid.h"
+#include "rollingHeightmap.h"
 
 class HeightmapWidget : public QWidget
 {
@@ -16,12 +18,18 @@ public slots:
     //void setImagePart(const IplImage *img, const QRect &rect);
     void setImage(const QImage &img);
     void setImage(const IplImage *img);
+    void setScanGrid(const ScanGrid *grid);
+    void setRollingHeightmap(const RollingHeightmap *map);
 
 protected:
     QImage  m_image;            ///< display image data
     cv::Mat m_heightMap;        ///< heightmap data
     double  m_scaleX;           ///< display scale x
     double  m_scaleY;           ///< display scale y
+    int     m_iGridTiles;       ///< scan grid tiles shown in m_image; -1 if m_image doesn't show a scan grid
+    int     m_iGridFirstRow;    ///< scan grid row shown in the first image row
+    quint64 m_iGridGeneration;  ///< scan grid generation shown in m_image
+    quint64 m_iGridEpoch;       ///< scan grid reset epoch shown in m_image
 
     virtual void paintEvent(QPaintEvent *event);
 };
@@ -0,0 +1,252 @@
+#include "laserExtract.h"
+#include "QtException.h"
+
+//vector kernels need per-function target attributes, i.e. gcc >= 4.9 or clang, on x86
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+    #define LASEREXTRACT_X86    1
+    #include <immintrin.h>
+#else
+    #define LASEREXTRACT_X86    0
+#endif
+
+typedef void (*LaserExtractRowFunc)(const unsigned char *bgr, float *dst, int width);
+
+/**
+  @brief    reference implementation, one pixel at a time
+
+  integer formulation of R - 0.25*G - 0.25*B; saves the int to double conversions
+  **/
+static void laserExtractRowScalar(const unsigned char *bgr, float *dst, int width)
+{
+    int value;
+    for (int x = 0; x < width; x++) {
+        value = 4 * int(bgr[2]) - int(bgr[1]) - int(bgr[0]);
+        *dst = (value > 0) ? float(value) * 0.25f : 0.0f;
+        ++dst;
+        bgr += 3;
+    }
+}
+
+#if LASEREXTRACT_X86
+
+/**
+  @brief    split 16 interleaved bgr pixels (48 bytes) into planar 16 byte vectors
+  **/
+__attribute__((target("ssse3")))
+static inline void deinterleaveBGR(const unsigned char *bgr, __m128i &b, __m128i &g, __m128i &r)
+{
+    const __m128i s0 = _mm_loadu_si128((const __m128i*) (bgr));
+    const __m128i s1 = _mm_loadu_si128((const __m128i*) (bgr + 16));
+    const __m128i s2 = _mm_loadu_si128((const __m128i*) (bgr + 32));
+
+    b = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(s0, _mm_setr_epi8( 0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(s1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(s2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  1,  4,  7, 10, 13)));
+    g = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(s0, _mm_setr_epi8( 1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(s1, _mm_setr_epi8(-1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(s2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14)));
+    r = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(s0, _mm_setr_epi8( 2,  5,  8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(s1, _mm_setr_epi8(-1, -1, -1, -1, -1,  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(s2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15)));
+}
+
+/**
+  @brief    4 int32 of (4R - G - B) to float, scale, truncate negatives, store
+  **/
+__attribute__((target("ssse3")))
+static inline void storeLaser4(float *dst, __m128i v32)
+{
+    __m128 f = _mm_mul_ps(_mm_cvtepi32_ps(v32), _mm_set1_ps(0.25f));
+    _mm_storeu_ps(dst, _mm_max_ps(f, _mm_setzero_ps()));    //max(+-0, +0) yields +0 like the scalar code
+}
+
+/**
+  @brief    128 bit implementation: 16 pixels per step
+  **/
+__attribute__((target("ssse3")))
+static void laserExtractRowSSSE3(const unsigned char *bgr, float *dst, int width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x <= width - 16; x += 16) {
+        __m128i b, g, r;
+        deinterleaveBGR(bgr + 3*x, b, g, r);
+
+        // 4R - G - B in int16: range -510..1020
+        __m128i lo = _mm_sub_epi16(_mm_slli_epi16(_mm_unpacklo_epi8(r, zero), 2),
+                                   _mm_add_epi16(_mm_unpacklo_epi8(g, zero), _mm_unpacklo_epi8(b, zero)));
+        __m128i hi = _mm_sub_epi16(_mm_slli_epi16(_mm_unpackhi_epi8(r, zero), 2),
+                                   _mm_add_epi16(_mm_unpackhi_epi8(g, zero), _mm_unpackhi_epi8(b, zero)));
+
+        // sign extend to int32
+        storeLaser4(dst + x,      _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16));
+        storeLaser4(dst + x + 4,  _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16));
+        storeLaser4(dst + x + 8,  _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16));
+        storeLaser4(dst + x + 12, _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16));
+    }
+    laserExtractRowScalar(bgr + 3*x, dst + x, width - x);
+}
+
+/**
+  @brief    256 bit implementation: 16 pixels per step, integer and float math 16/8 wide
+  **/
+__attribute__((target("avx2")))
+static void laserExtractRowAVX2(const unsigned char *bgr, float *dst, int width)
+{
+    const __m256 scale = _mm256_set1_ps(0.25f);
+    const __m256 zero = _mm256_setzero_ps();
+    int x = 0;
+    for (; x <= width - 16; x += 16) {
+        __m128i b, g, r;
+        deinterleaveBGR(bgr + 3*x, b, g, r);
+
+        __m256i v = _mm256_sub_epi16(_mm256_slli_epi16(_mm256_cvtepu8_epi16(r), 2),
+                                     _mm256_add_epi16(_mm256_cvtepu8_epi16(g), _mm256_cvtepu8_epi16(b)));
+
+        __m256 f0 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)));
+        __m256 f1 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)));
+        _mm256_storeu_ps(dst + x,     _mm256_max_ps(_mm256_mul_ps(f0, scale), zero));
+        _mm256_storeu_ps(dst + x + 8, _mm256_max_ps(_mm256_mul_ps(f1, scale), zero));
+    }
+    laserExtractRowScalar(bgr + 3*x, dst + x, width - x);
+}
+
+#endif // LASEREXTRACT_X86
+
+static int                 g_iLaserExtractImpl = LASEREXTRACT_AUTO;    ///< currently selected implementation
+static LaserExtractRowFunc g_laserExtractRow = NULL;                   ///< currently selected kernel
+
+/**
+  @brief    check if the cpu we're running on can do impl
+  @param    impl    one of LASEREXTRACT_*
+  **/
+bool laserExtractSupported(int impl)
+{
+    switch (impl) {
+    case LASEREXTRACT_AUTO:
+    case LASEREXTRACT_SCALAR:
+        return true;
+#if LASEREXTRACT_X86
+    case LASEREXTRACT_SSSE3:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("ssse3");
+    case LASEREXTRACT_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+/**
+  @brief    select the kernel implementation
+  @param    impl    one of LASEREXTRACT_*; LASEREXTRACT_AUTO picks the fastest supported one
+  @return   false if impl is not supported on this cpu (selection unchanged)
+
+  Forcing an implementation is meant for verification and benchmarking.
+  **/
+bool laserExtractSetImplementation(int impl)
+{
+    if (!laserExtractSupported(impl)) {
+        DEBUG(1, QString("Laser extraction implementation %1 not supported by this cpu").arg(impl));
+        return false;
+    }
+    if (impl == LASEREXTRACT_AUTO) {
+        if (laserExtractSupported(LASEREXTRACT_AVX2)) {
+            impl = LASEREXTRACT_AVX2;
+        } else if (laserExtractSupported(LASEREXTRACT_SSSE3)) {
+            impl = LASEREXTRACT_SSSE3;
+        } else {
+            impl = LASEREXTRACT_SCALAR;
+        }
+    }
+    switch (impl) {
+#if LASEREXTRACT_X86
+    case LASEREXTRACT_AVX2:
+        g_laserExtractRow = laserExtractRowAVX2;
+        break;
+    case LASEREXTRACT_SSSE3:
+        g_laserExtractRow = laserExtractRowSSSE3;
+        break;
+#endif
+    default:
+        g_laserExtractRow = laserExtractRowScalar;
+        break;
+    }
+    g_iLaserExtractImpl = impl;
+    DEBUG(10, QString("Laser extraction implementation %1").arg(impl));
+    return true;
+}
+
+/**
+  @brief    get currently selected implementation
+  **/
+int laserExtractImplementation()
+{
+    if (!g_laserExtractRow)
+        laserExtractSetImplementation(LASEREXTRACT_AUTO);
+    return g_iLaserExtractImpl;
+}
+
+/**
+  @brief    convert one row of bgr pixels
+  @param    bgr     width packed 3 byte pixels
+  @param    dst     width floats
+  **/
+void laserExtractRow(const unsigned char *bgr, float *dst, int width)
+{
+    if (!g_laserExtractRow)
+        laserExtractSetImplementation(LASEREXTRACT_AUTO);
+    g_laserExtractRow(bgr, dst, width);
+}
+
+/**
+  @brief    convert whole image
+  @param    bgr     IPL_DEPTH_8U source with at least 3 channels (b, g, r, ...)
+  @param    dst     IPL_DEPTH_32F single channel target of same size
+  **/
+void laserExtract(const IplImage *bgr, IplImage *dst)
+{
+    laserExtract(bgr, dst, cvRect(0, 0, bgr->width, bgr->height));
+}
+
+/**
+  @brief    convert part of an image; pixels of dst outside rect are left untouched
+  @param    bgr     IPL_DEPTH_8U source with at least 3 channels (b, g, r, ...)
+  @param    dst     IPL_DEPTH_32F single channel target of same size
+  @param    rect    area to convert, same coordinates in bgr and dst; image rois are ignored
+  **/
+void laserExtract(const IplImage *bgr, IplImage *dst, CvRect rect)
+{
+    if (bgr->depth != IPL_DEPTH_8U || bgr->nChannels < 3 || dst->depth != IPL_DEPTH_32F || dst->nChannels != 1
+            || bgr->width != dst->width || bgr->height != dst->height) {
+        EX_THROW("laserExtract: invalid image format");
+    }
+    if (rect.x < 0 || rect.y < 0 || rect.width < 0 || rect.height < 0
+            || rect.x + rect.width > bgr->width || rect.y + rect.height > bgr->height) {
+        EX_THROW("laserExtract: rect exceeds image");
+    }
+    if (!g_laserExtractRow)
+        laserExtractSetImplementation(LASEREXTRACT_AUTO);
+
+    for (int y = rect.y; y < rect.y + rect.height; y++) {
+        const unsigned char *src = (const unsigned char*) (bgr->imageData + y * bgr->widthStep) + rect.x * bgr->nChannels;
+        float *data = (float*) (dst->imageData + y * dst->widthStep) + rect.x;
+        if (bgr->nChannels == 3) {
+            g_laserExtractRow(src, data, rect.width);
+        } else {    //e.g. bgra: no vector kernel for that, walk pixel by pixel
+            int value;
+            for (int x = 0; x < rect.width; x++) {
+                value = 4 * int(src[2]) - int(src[1]) - int(src[0]);
+                *data = (value > 0) ? float(value) * 0.25f : 0.0f;
+                ++data;
+                src += bgr->nChannels;
+            }
+        }
+    }
+}
@@ -0,0 +1,29 @@
+/**
+  @file     laserExtract.h
+  @brief    convert a bgr camera frame to laser intensity: R - 0.25 G - 0.25 B, negatives truncated to zero
+
+  The vectorized implementations are selected at runtime by cpu detection. All of them give
+  bit-identical results to the scalar one: 4R - G - B is exact in integers and the final
+  multiplication by 0.25 is exact in float.
+  **/
+
+#ifndef LASEREXTRACT_H
+#define LASEREXTRACT_H
+
+#include <opencv.hpp>
+
+//implementations of the laser extraction kernel
+#define LASEREXTRACT_AUTO       0       ///< pick the best one the cpu supports
+#define LASEREXTRACT_SCALAR     1       ///< plain c++, reference
+#define LASEREXTRACT_SSSE3      2       ///< 16 pixels per step
+#define LASEREXTRACT_AVX2       3       ///< 16 pixels per step, 8 wide float math
+
+void laserExtract(const IplImage *bgr, IplImage *dst);
+void laserExtract(const IplImage *bgr, IplImage *dst, CvRect rect);
+void laserExtractRow(const unsigned char *bgr, float *dst, int width);
+
+bool laserExtractSetImplementation(int impl);
+int  laserExtractImplementation();
+bool laserExtractSupported(int impl);
+
+#endif // LASEREXTRACT_H
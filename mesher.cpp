@@ -0,0 +1,323 @@
+#include "mesher.h"
+#include "QtException.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QtEndian>
+#include <string.h>
+#include <math.h>
+
+#define USE_OPENMP      1       ///< mesh row bands in parallel with openmp
+
+#if USE_OPENMP
+    #include <omp.h>
+#endif
+
+/**
+  @brief    buffered binary output to a QIODevice
+  **/
+class MeshOutput
+{
+public:
+    MeshOutput(QIODevice *dev) : m_dev(dev), m_buffer(MESHER_BUFFER_SIZE), m_iUsed(0), m_bError(false) {}
+
+    inline void put(const void *data, size_t bytes)
+    {
+        if (m_iUsed + bytes > m_buffer.size()) {
+            flush();
+            if (bytes > m_buffer.size()) {  //large blocks go out directly
+                if (m_dev->write((const char*) data, qint64(bytes)) != qint64(bytes))
+                    m_bError = true;
+                return;
+            }
+        }
+        memcpy(&m_buffer[m_iUsed], data, bytes);
+        m_iUsed += bytes;
+    }
+    inline void putLittleEndian(float v)
+    {
+        quint32 bits;
+        memcpy(&bits, &v, sizeof(bits));
+        bits = qToLittleEndian(bits);
+        put(&bits, sizeof(bits));
+    }
+    bool flush()
+    {
+        if (m_iUsed > 0 && m_dev->write(&m_buffer[0], qint64(m_iUsed)) != qint64(m_iUsed))
+            m_bError = true;
+        m_iUsed = 0;
+        return !m_bError;
+    }
+
+private:
+    QIODevice*          m_dev;
+    std::vector<char>   m_buffer;
+    size_t              m_iUsed;
+    bool                m_bError;
+};
+
+/**
+  @brief    squared distance of two vertices
+  **/
+static inline double distance2(const float *a, const float *b)
+{
+    double dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+    return dx * dx + dy * dy + dz * dz;
+}
+
+GridMesher::GridMesher()
+{
+    m_dMaxEdge = MESHER_MAX_EDGE_DEFAULT;
+    m_iWorkers = MESHER_WORKERS_AUTO;
+}
+
+/**
+  @brief    set the discontinuity threshold
+  @param    maxEdge longest triangle edge in output units; <= 0 keeps all triangles of valid samples
+  **/
+void GridMesher::setMaxEdge(double maxEdge)
+{
+    m_dMaxEdge = maxEdge;
+}
+
+/**
+  @brief    set number of threads
+  @param    workers number of threads; MESHER_WORKERS_AUTO uses all cores, 1 is serial
+  **/
+void GridMesher::setWorkers(int workers)
+{
+    m_iWorkers = (workers > 0) ? workers : MESHER_WORKERS_AUTO;
+}
+
+void GridMesher::clear()
+{
+    m_vertices.clear();
+    m_triangles.clear();
+}
+
+/**
+  @brief    mesh an organized point cloud
+  @param    organized   64 bit (or 32 bit) x, y, z per grid sample; invalid samples are NaN
+  **/
+void GridMesher::build(const cv::Mat &organized)
+{
+    clear();
+    if (organized.empty())
+        return;
+    cv::Mat grid = organized;
+    if (grid.type() != CV_64FC3)
+        organized.convertTo(grid, CV_64FC3);
+    const int rows = grid.rows;
+    const int columns = grid.cols;
+#if USE_OPENMP
+    const int workers = (m_iWorkers > 0) ? m_iWorkers : omp_get_max_threads();
+#endif
+
+    //vertex numbering: count valid samples per row, then each row numbers its own from the prefix sum
+    std::vector<quint32> rowStart(rows + 1, 0);
+#if USE_OPENMP
+    #pragma omp parallel for num_threads(workers) schedule(static) if(workers > 1)
+#endif
+    for (int y = 0; y < rows; y++) {
+        const double *p = grid.ptr<double>(y);
+        quint32 count = 0;
+        for (int x = 0; x < columns; x++, p += 3) {
+            if (p[0] == p[0])   //not NaN
+                count++;
+        }
+        rowStart[y + 1] = count;
+    }
+    for (int y = 0; y < rows; y++)
+        rowStart[y + 1] += rowStart[y];
+    if (rowStart[rows] == 0)
+        return;
+
+    m_vertices.resize(3 * size_t(rowStart[rows]));
+    cv::Mat index(rows, columns, CV_32SC1);
+#if USE_OPENMP
+    #pragma omp parallel for num_threads(workers) schedule(static) if(workers > 1)
+#endif
+    for (int y = 0; y < rows; y++) {
+        const double *p = grid.ptr<double>(y);
+        int *idx = index.ptr<int>(y);
+        quint32 next = rowStart[y];
+        for (int x = 0; x < columns; x++, p += 3) {
+            if (p[0] == p[0]) {
+                float *v = &m_vertices[3 * size_t(next)];
+                v[0] = float(p[0]);
+                v[1] = float(p[1]);
+                v[2] = float(p[2]);
+                idx[x] = int(next++);
+            } else {
+                idx[x] = -1;
+            }
+        }
+    }
+
+    //triangles per band of cells, joined in band order afterwards
+    const int cellRows = rows - 1;
+    const int bands = (cellRows + MESHER_BAND_ROWS - 1) / MESHER_BAND_ROWS;
+    const double maxEdge2 = (m_dMaxEdge > 0.) ? m_dMaxEdge * m_dMaxEdge : HUGE_VAL;
+    const float *vertices = &m_vertices[0];
+    std::vector< std::vector<quint32> > bandTriangles(qMax(bands, 0));
+#if USE_OPENMP
+    #pragma omp parallel for num_threads(workers) schedule(dynamic) if(workers > 1)
+#endif
+    for (int band = 0; band < bands; band++) {
+        std::vector<quint32> &tris = bandTriangles[band];
+        const int yEnd = qMin((band + 1) * MESHER_BAND_ROWS, cellRows);
+        for (int y = band * MESHER_BAND_ROWS; y < yEnd; y++) {
+            const int *top = index.ptr<int>(y);
+            const int *bottom = index.ptr<int>(y + 1);
+            for (int x = 0; x + 1 < columns; x++) {
+                //cell corners: a b
+                //              c d
+                int c[4] = {top[x], top[x + 1], bottom[x], bottom[x + 1]};
+                int valid = (c[0] >= 0) + (c[1] >= 0) + (c[2] >= 0) + (c[3] >= 0);
+                if (valid < 3)
+                    continue;
+                int t[6];
+                int n = 0;
+                if (valid == 4) {   //split along the shorter diagonal
+                    if (distance2(vertices + 3 * c[0], vertices + 3 * c[3]) <= distance2(vertices + 3 * c[1], vertices + 3 * c[2])) {
+                        t[0] = c[0]; t[1] = c[2]; t[2] = c[3];
+                        t[3] = c[0]; t[4] = c[3]; t[5] = c[1];
+                    } else {
+                        t[0] = c[0]; t[1] = c[2]; t[2] = c[1];
+                        t[3] = c[1]; t[4] = c[2]; t[5] = c[3];
+                    }
+                    n = 2;
+                } else {            //same winding as above, leaving out the missing corner
+                    if (c[0] < 0)      { t[0] = c[1]; t[1] = c[2]; t[2] = c[3]; }
+                    else if (c[1] < 0) { t[0] = c[0]; t[1] = c[2]; t[2] = c[3]; }
+                    else if (c[2] < 0) { t[0] = c[0]; t[1] = c[3]; t[2] = c[1]; }
+                    else               { t[0] = c[0]; t[1] = c[2]; t[2] = c[1]; }
+                    n = 1;
+                }
+                for (int i = 0; i < n; i++) {
+                    const int *tri = t + 3 * i;
+                    const float *v0 = vertices + 3 * tri[0];
+                    const float *v1 = vertices + 3 * tri[1];
+                    const float *v2 = vertices + 3 * tri[2];
+                    if (distance2(v0, v1) > maxEdge2 || distance2(v1, v2) > maxEdge2 || distance2(v2, v0) > maxEdge2)
+                        continue;   //depth discontinuity
+                    tris.push_back(quint32(tri[0]));
+                    tris.push_back(quint32(tri[1]));
+                    tris.push_back(quint32(tri[2]));
+                }
+            }
+        }
+    }
+
+    std::vector<size_t> bandStart(bands + 1, 0);
+    for (int band = 0; band < bands; band++)
+        bandStart[band + 1] = bandStart[band] + bandTriangles[band].size();
+    m_triangles.resize(bandStart[bands]);
+#if USE_OPENMP
+    #pragma omp parallel for num_threads(workers) schedule(static) if(workers > 1)
+#endif
+    for (int band = 0; band < bands; band++) {
+        if (!bandTriangles[band].empty())
+            memcpy(&m_triangles[bandStart[band]], &bandTriangles[band][0], bandTriangles[band].size() * sizeof(quint32));
+    }
+}
+
+/**
+  @brief    guess the format from a file's suffix
+  @return   MESH_FORMAT_*; -1 if unknown
+  **/
+int GridMesher::formatFromFileName(const QString &fileName)
+{
+    QString suffix = QFileInfo(fileName).suffix().toLower();
+    if (suffix == "ply")
+        return MESH_FORMAT_PLY;
+    if (suffix == "stl")
+        return MESH_FORMAT_STL;
+    return -1;
+}
+
+/**
+  @brief    write the mesh into a file
+  @param    format  MESH_FORMAT_*; -1 to choose by suffix
+  @return   false on error; an incomplete file is removed
+  **/
+bool GridMesher::save(const QString &fileName, int format /*= -1*/) const
+{
+    if (format < 0)
+        format = formatFromFileName(fileName);
+    if (format < 0) {
+        DEBUG(1, QString("Unknown mesh format of %1").arg(fileName));
+        return false;
+    }
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        DEBUG(1, QString("Could not open %1 for writing").arg(fileName));
+        return false;
+    }
+    bool ok = (format == MESH_FORMAT_STL) ? writeStl(&file) : writePly(&file);
+    file.close();
+    if (!ok) {
+        DEBUG(1, QString("Write error on %1").arg(fileName));
+        QFile::remove(fileName);
+    }
+    return ok;
+}
+
+/**
+  @brief    binary PLY: vertex list, then faces as vertex index triples
+  **/
+bool GridMesher::writePly(QIODevice *dev) const
+{
+    MeshOutput out(dev);
+    QByteArray header = "ply\n";
+    header += (Q_BYTE_ORDER == Q_LITTLE_ENDIAN) ? "format binary_little_endian 1.0\n" : "format binary_big_endian 1.0\n";
+    header += "element vertex " + QByteArray::number(quint64(vertexCount())) + "\n";
+    header += "property float x\nproperty float y\nproperty float z\n";
+    header += "element face " + QByteArray::number(quint64(triangleCount())) + "\n";
+    header += "property list uchar int vertex_indices\n";
+    header += "end_header\n";
+    out.put(header.constData(), header.size());
+    if (!m_vertices.empty())
+        out.put(&m_vertices[0], m_vertices.size() * sizeof(float));
+    const unsigned char corners = 3;
+    for (size_t i = 0; i < m_triangles.size(); i += 3) {
+        char face[1 + 3 * sizeof(qint32)];
+        face[0] = char(corners);
+        memcpy(face + 1, &m_triangles[i], 3 * sizeof(qint32));
+        out.put(face, sizeof(face));
+    }
+    return out.flush();
+}
+
+/**
+  @brief    binary STL: facet normal and three corners per triangle
+  **/
+bool GridMesher::writeStl(QIODevice *dev) const
+{
+    MeshOutput out(dev);
+    char header[80];
+    memset(header, 0, sizeof(header));
+    strncpy(header, "cLaserScanner grid mesh", sizeof(header) - 1);
+    out.put(header, sizeof(header));
+    quint32 count = qToLittleEndian(quint32(triangleCount()));
+    out.put(&count, sizeof(count));
+    const quint16 attributes = 0;
+    for (size_t i = 0; i < m_triangles.size(); i += 3) {
+        const float *v[3] = { &m_vertices[3 * size_t(m_triangles[i])],
+                              &m_vertices[3 * size_t(m_triangles[i + 1])],
+                              &m_vertices[3 * size_t(m_triangles[i + 2])] };
+        float e1[3] = {v[1][0] - v[0][0], v[1][1] - v[0][1], v[1][2] - v[0][2]};
+        float e2[3] = {v[2][0] - v[0][0], v[2][1] - v[0][1], v[2][2] - v[0][2]};
+        float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+        float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (len > 0.0f) {
+            n[0] /= len; n[1] /= len; n[2] /= len;
+        }
+        for (int k = 0; k < 3; k++)
+            out.putLittleEndian(n[k]);
+        for (int j = 0; j < 3; j++)
+            for (int k = 0; k < 3; k++)
+                out.putLittleEndian(v[j][k]);
+        out.put(&attributes, sizeof(attributes));
+    }
+    return out.flush();
+}
@@ -0,0 +1,60 @@
+#ifndef MESHER_H
+#define MESHER_H
+
+#include <vector>
+#include <QString>
+#include <QIODevice>
+#include <opencv.hpp>
+
+#define MESH_FORMAT_PLY             0       ///< binary PLY with indexed faces, native byte order
+#define MESH_FORMAT_STL             1       ///< binary STL, little endian
+
+#define MESHER_WORKERS_AUTO         0       ///< one thread per core
+#define MESHER_BAND_ROWS            32      ///< grid rows meshed by one thread at a time
+#define MESHER_MAX_EDGE_DEFAULT     2.0     ///< longest triangle edge in output units (mm if calibrated)
+#define MESHER_BUFFER_SIZE          (1 << 20)   ///< bytes collected before each file write
+
+
+/**
+  @class    GridMesher  triangle mesh straight from an organized point cloud
+
+  Every grid cell whose corners are valid gives two triangles, split along the shorter diagonal; a cell
+  with three valid corners gives one. Triangles with an edge longer than maxEdge() are dropped, so the
+  mesh tears at depth discontinuities instead of bridging them. Only valid samples become vertices.
+  Rows are meshed in parallel bands.
+  **/
+class GridMesher
+{
+public:
+    GridMesher();
+
+    void            setMaxEdge(double maxEdge);
+    double          maxEdge() const                 { return m_dMaxEdge; }
+    void            setWorkers(int workers);
+
+    void            clear();
+    void            build(const cv::Mat &organized);
+    size_t          vertexCount() const             { return m_vertices.size() / 3; }
+    size_t          triangleCount() const           { return m_triangles.size() / 3; }
+    bool            isEmpty() const                 { return m_triangles.empty(); }
+
+    /** @brief  x, y, z per vertex **/
+    const float*    vertices() const                { return m_vertices.empty() ? NULL : &m_vertices[0]; }
+    /** @brief  three vertex indices per triangle **/
+    const quint32*  triangles() const               { return m_triangles.empty() ? NULL : &m_triangles[0]; }
+
+    bool            save(const QString &fileName, int format = -1) const;
+    static int      formatFromFileName(const QString &fileName);
+
+private:
+    bool            writePly(QIODevice *dev) const;
+    bool            writeStl(QIODevice *dev) const;
+
+private:
+    double                  m_dMaxEdge;     ///< discontinuity threshold; <= 0 keeps all triangles
+    int                     m_iWorkers;     ///< threads, MESHER_WORKERS_AUTO for all cores
+    std::vector<float>      m_vertices;     ///< valid samples, row by row
+    std::vector<quint32>    m_triangles;    ///< indices into m_vertices
+};
+
+#endif // MESHER_H
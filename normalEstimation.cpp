@@ -0,0 +1,263 @@
+#include "normalEstimation.h"
+#include "mesher.h"
+#include <limits>
+#include <algorithm>
+#include <math.h>
+
+#define USE_OPENMP      1       ///< estimate rows in parallel with openmp
+
+#if USE_OPENMP
+    #include <omp.h>
+#endif
+
+//vector kernels need per-function target attributes, i.e. gcc >= 4.9 or clang, on x86
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+    #define NORMALS_X86         1
+    #include <immintrin.h>
+#else
+    #define NORMALS_X86         0
+#endif
+
+typedef void (*NormalsRowFunc)(const double *up, const double *p, const double *down, int from, int to, double max2, float *n);
+
+/**
+  @brief    d = a - b if both are valid and no farther apart than the limit
+  **/
+static inline bool difference(const double *a, const double *b, double max2, double *d)
+{
+    if (a[0] != a[0] || b[0] != b[0])   //NaN: no point
+        return false;
+    d[0] = a[0] - b[0];
+    d[1] = a[1] - b[1];
+    d[2] = a[2] - b[2];
+    return d[0] * d[0] + d[1] * d[1] + d[2] * d[2] <= max2;
+}
+
+/**
+  @brief    squared distance of a and b; NaN if one of them is invalid
+  **/
+static inline double distance2(const double *a, const double *b)
+{
+    double d0 = a[0] - b[0], d1 = a[1] - b[1], d2 = a[2] - b[2];
+    return d0 * d0 + d1 * d1 + d2 * d2;
+}
+
+/**
+  @brief    interior normals of one row from central differences, reference implementation
+  @param    up, p, down     previous, current and next grid row
+  @param    from, to        columns [from, to) to do; their left and right neighbours must exist
+  @param    max2            squared discontinuity threshold
+  @param    n               normals of the row; NaN for invalid samples, NaN neighbours and discontinuities
+  **/
+static void interiorNormalsScalar(const double *up, const double *p, const double *down, int from, int to, double max2, float *n)
+{
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    for (int x = from; x < to; x++) {
+        const int i = 3 * x;
+        double du0 = p[i + 3] - p[i - 3], du1 = p[i + 4] - p[i - 2], du2 = p[i + 5] - p[i - 1];
+        double dv0 = down[i] - up[i], dv1 = down[i + 1] - up[i + 1], dv2 = down[i + 2] - up[i + 2];
+        double c0 = dv1 * du2 - dv2 * du1;
+        double c1 = dv2 * du0 - dv0 * du2;
+        double c2 = dv0 * du1 - dv1 * du0;
+        double len2 = c0 * c0 + c1 * c1 + c2 * c2;
+        //every step on its own: a central difference within two steps may still hide one step beyond maxEdge
+        bool ok = (p[i] == p[i]) & (len2 > 0.)
+                & (distance2(p + i, p + i + 3) <= max2) & (distance2(p + i, p + i - 3) <= max2)
+                & (distance2(p + i, down + i) <= max2) & (distance2(p + i, up + i) <= max2);
+        double scale = ok ? 1. / sqrt(len2) : nan;
+        n[i] = float(c0 * scale);
+        n[i + 1] = float(c1 * scale);
+        n[i + 2] = float(c2 * scale);
+    }
+}
+
+#if NORMALS_X86
+
+/**
+  @brief    split 4 interleaved points (12 doubles) into x, y and z vectors
+  **/
+__attribute__((target("avx2")))
+static inline void deinterleaveXYZ(const double *p, __m256d &x, __m256d &y, __m256d &z)
+{
+    const __m256d a = _mm256_loadu_pd(p);         //x0 y0 z0 x1
+    const __m256d b = _mm256_loadu_pd(p + 4);     //y1 z1 x2 y2
+    const __m256d c = _mm256_loadu_pd(p + 8);     //z2 x3 y3 z3
+    x = _mm256_permute4x64_pd(_mm256_blend_pd(_mm256_blend_pd(a, b, 0x4), c, 0x2), 0x6C);    //x0 x3 x2 x1 -> x0..x3
+    y = _mm256_permute4x64_pd(_mm256_blend_pd(_mm256_blend_pd(a, b, 0x9), c, 0x4), 0xB1);    //y1 y0 y3 y2 -> y0..y3
+    z = _mm256_permute4x64_pd(_mm256_blend_pd(_mm256_blend_pd(a, b, 0x2), c, 0x9), 0xC6);    //z2 z1 z0 z3 -> z0..z3
+}
+
+/**
+  @brief    squared distances of 4 point pairs; NaN where a point is invalid
+  **/
+__attribute__((target("avx2")))
+static inline __m256d distance2AVX2(__m256d ax, __m256d ay, __m256d az, __m256d bx, __m256d by, __m256d bz)
+{
+    const __m256d dx = _mm256_sub_pd(ax, bx);
+    const __m256d dy = _mm256_sub_pd(ay, by);
+    const __m256d dz = _mm256_sub_pd(az, bz);
+    return _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_mul_pd(dz, dz));
+}
+
+/**
+  @brief    avx2 interior normals; 4 samples per step, same results as the scalar version
+  **/
+__attribute__((target("avx2")))
+static void interiorNormalsAVX2(const double *up, const double *p, const double *down, int from, int to, double max2, float *n)
+{
+    const __m256d limit = _mm256_set1_pd(max2);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.);
+    const __m256d nan = _mm256_set1_pd(std::numeric_limits<double>::quiet_NaN());
+    int x = from;
+    for (; x + 4 <= to; x += 4) {
+        const int i = 3 * x;
+        __m256d px, py, pz, lx, ly, lz, rx, ry, rz, ux, uy, uz, dx, dy, dz;
+        deinterleaveXYZ(p + i, px, py, pz);
+        deinterleaveXYZ(p + i - 3, lx, ly, lz);
+        deinterleaveXYZ(p + i + 3, rx, ry, rz);
+        deinterleaveXYZ(up + i, ux, uy, uz);
+        deinterleaveXYZ(down + i, dx, dy, dz);
+
+        const __m256d du0 = _mm256_sub_pd(rx, lx), du1 = _mm256_sub_pd(ry, ly), du2 = _mm256_sub_pd(rz, lz);
+        const __m256d dv0 = _mm256_sub_pd(dx, ux), dv1 = _mm256_sub_pd(dy, uy), dv2 = _mm256_sub_pd(dz, uz);
+        const __m256d c0 = _mm256_sub_pd(_mm256_mul_pd(dv1, du2), _mm256_mul_pd(dv2, du1));
+        const __m256d c1 = _mm256_sub_pd(_mm256_mul_pd(dv2, du0), _mm256_mul_pd(dv0, du2));
+        const __m256d c2 = _mm256_sub_pd(_mm256_mul_pd(dv0, du1), _mm256_mul_pd(dv1, du0));
+        const __m256d len2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(c0, c0), _mm256_mul_pd(c1, c1)), _mm256_mul_pd(c2, c2));
+
+        //ordered compares are false for NaN, so invalid samples and neighbours fail here, too
+        __m256d ok = _mm256_cmp_pd(len2, zero, _CMP_GT_OQ);
+        ok = _mm256_and_pd(ok, _mm256_cmp_pd(distance2AVX2(px, py, pz, rx, ry, rz), limit, _CMP_LE_OQ));
+        ok = _mm256_and_pd(ok, _mm256_cmp_pd(distance2AVX2(px, py, pz, lx, ly, lz), limit, _CMP_LE_OQ));
+        ok = _mm256_and_pd(ok, _mm256_cmp_pd(distance2AVX2(px, py, pz, dx, dy, dz), limit, _CMP_LE_OQ));
+        ok = _mm256_and_pd(ok, _mm256_cmp_pd(distance2AVX2(px, py, pz, ux, uy, uz), limit, _CMP_LE_OQ));
+        const __m256d scale = _mm256_blendv_pd(nan, _mm256_div_pd(one, _mm256_sqrt_pd(len2)), ok);
+
+        float n0[4], n1[4], n2[4];
+        _mm_storeu_ps(n0, _mm256_cvtpd_ps(_mm256_mul_pd(c0, scale)));
+        _mm_storeu_ps(n1, _mm256_cvtpd_ps(_mm256_mul_pd(c1, scale)));
+        _mm_storeu_ps(n2, _mm256_cvtpd_ps(_mm256_mul_pd(c2, scale)));
+        for (int k = 0; k < 4; k++) {
+            n[i + 3 * k] = n0[k];
+            n[i + 3 * k + 1] = n1[k];
+            n[i + 3 * k + 2] = n2[k];
+        }
+    }
+    interiorNormalsScalar(up, p, down, x, to, max2, n);     //tail
+}
+
+/**
+  @brief    check if the cpu we're running on can do avx2
+  **/
+static bool cpuHasAVX2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif // NORMALS_X86
+
+NormalEstimator::NormalEstimator()
+{
+    m_dMaxEdge = MESHER_MAX_EDGE_DEFAULT;
+    m_iWorkers = NORMALS_WORKERS_AUTO;
+}
+
+/**
+  @brief    set the discontinuity threshold
+  @param    maxEdge longest distance to a grid neighbour in output units; <= 0 uses all neighbours
+  **/
+void NormalEstimator::setMaxEdge(double maxEdge)
+{
+    m_dMaxEdge = maxEdge;
+}
+
+/**
+  @brief    set number of threads
+  @param    workers number of threads; NORMALS_WORKERS_AUTO uses all cores, 1 is serial
+  **/
+void NormalEstimator::setWorkers(int workers)
+{
+    m_iWorkers = (workers > 0) ? workers : NORMALS_WORKERS_AUTO;
+}
+
+/**
+  @brief    normals of all samples
+  @param    organized   64 bit x, y, z per grid sample, NaN if invalid
+  @param    normals     receives 32 bit unit normals in the same layout; NaN where there is no normal
+  **/
+void NormalEstimator::estimate(const cv::Mat &organized, cv::Mat *normals) const
+{
+    CV_Assert(organized.type() == CV_64FC3);
+    const int rows = organized.rows;
+    const int columns = organized.cols;
+    normals->create(rows, columns, CV_32FC3);
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const double max2 = (m_dMaxEdge > 0.) ? m_dMaxEdge * m_dMaxEdge : HUGE_VAL;
+    NormalsRowFunc interior = interiorNormalsScalar;    //chosen before the threads start
+#if NORMALS_X86
+    if (cpuHasAVX2())
+        interior = interiorNormalsAVX2;
+#endif
+#if USE_OPENMP
+    const int workers = (m_iWorkers > 0) ? m_iWorkers : omp_get_max_threads();
+    #pragma omp parallel for num_threads(workers) schedule(static) if(workers > 1)
+#endif
+    for (int y = 0; y < rows; y++) {
+        float *n = normals->ptr<float>(y);
+        if (y > 0 && y + 1 < rows && columns > 2) {
+            //interior: central differences; invalid samples, NaN neighbours and discontinuities give NaN, the latter fixed below
+            std::fill(n, n + 3, nan);
+            std::fill(n + 3 * (columns - 1), n + 3 * columns, nan);
+            interior(organized.ptr<double>(y - 1), organized.ptr<double>(y), organized.ptr<double>(y + 1), 1, columns - 1, max2, n);
+        } else {
+            std::fill(n, n + 3 * columns, nan);
+        }
+        //borders, holes and discontinuities
+        const double *p = organized.ptr<double>(y);
+        for (int x = 0; x < columns; x++) {
+            if (n[3 * x] != n[3 * x] && p[3 * x] == p[3 * x])
+                fallbackNormal(organized, y, x, n + 3 * x);
+        }
+    }
+}
+
+/**
+  @brief    normal from whatever neighbours are usable: central differences if possible, one sided otherwise
+  @return   false if there are not enough neighbours; n is left untouched
+  **/
+bool NormalEstimator::fallbackNormal(const cv::Mat &organized, int y, int x, float *n) const
+{
+    const double max2 = (m_dMaxEdge > 0.) ? m_dMaxEdge * m_dMaxEdge : HUGE_VAL;
+    const double *c = organized.ptr<double>(y) + 3 * x;
+    const double *neighbour[4] = {
+        (x + 1 < organized.cols) ? c + 3 : NULL,                            //next column
+        (x > 0) ? c - 3 : NULL,                                             //previous column
+        (y + 1 < organized.rows) ? organized.ptr<double>(y + 1) + 3 * x : NULL, //next row
+        (y > 0) ? organized.ptr<double>(y - 1) + 3 * x : NULL               //previous row
+    };
+    double d[2][3];
+    for (int k = 0; k < 2; k++) {
+        double forward[3], backward[3];
+        bool f = neighbour[2 * k] && difference(neighbour[2 * k], c, max2, forward);
+        bool b = neighbour[2 * k + 1] && difference(c, neighbour[2 * k + 1], max2, backward);
+        if (!f && !b)
+            return false;
+        for (int i = 0; i < 3; i++)
+            d[k][i] = (f && b) ? forward[i] + backward[i] : (f ? forward[i] : backward[i]);
+    }
+    const double *du = d[0];
+    const double *dv = d[1];
+    double c0 = dv[1] * du[2] - dv[2] * du[1];
+    double c1 = dv[2] * du[0] - dv[0] * du[2];
+    double c2 = dv[0] * du[1] - dv[1] * du[0];
+    double len = sqrt(c0 * c0 + c1 * c1 + c2 * c2);
+    if (len <= 0.)
+        return false;
+    n[0] = float(c0 / len);
+    n[1] = float(c1 / len);
+    n[2] = float(c2 / len);
+    return true;
+}
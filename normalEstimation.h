@@ -0,0 +1,37 @@
+#ifndef NORMALESTIMATION_H
+#define NORMALESTIMATION_H
+
+#include <opencv.hpp>
+
+#define NORMALS_WORKERS_AUTO        0       ///< one thread per core
+
+
+/**
+  @class    NormalEstimator     surface normals of an organized point cloud from its grid neighbours
+
+  The normal of a sample is the cross product of the central differences along the grid rows and
+  columns, oriented like the facets of GridMesher. Where a neighbour is missing or farther than
+  maxEdge() away (a depth discontinuity) the one sided difference is used instead. Rows are processed
+  in parallel; the common case of four good neighbours runs without branches, four samples at a time
+  with avx2 if the cpu has it.
+  **/
+class NormalEstimator
+{
+public:
+    NormalEstimator();
+
+    void    setMaxEdge(double maxEdge);
+    double  maxEdge() const             { return m_dMaxEdge; }
+    void    setWorkers(int workers);
+
+    void    estimate(const cv::Mat &organized, cv::Mat *normals) const;
+
+private:
+    bool    fallbackNormal(const cv::Mat &organized, int y, int x, float *n) const;
+
+private:
+    double  m_dMaxEdge;     ///< longest distance to a neighbour still on the same surface; <= 0 for no limit
+    int     m_iWorkers;     ///< threads, NORMALS_WORKERS_AUTO for all cores
+};
+
+#endif // NORMALESTIMATION_H
@@ -0,0 +1,160 @@
+#include "peakDetect.h"
+#include <math.h>
+
+//vector kernels need per-function target attributes, i.e. gcc >= 4.9 or clang, on x86
+#if (defined(__i386__) || defined(__x86_64__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+    #define PEAKDETECT_X86      1
+    #include <immintrin.h>
+#else
+    #define PEAKDETECT_X86      0
+#endif
+
+/**
+  @brief    scalar arg max; reference and tail handling
+  **/
+static int peakArgMaxScalar(const float *row, int from, int to, float *power)
+{
+    float p = 0;
+    int xpos = from;
+    for (int x = from; x < to; x++) {
+        if (row[x] > p) {
+            p = row[x];
+            xpos = x;
+        }
+    }
+    *power = p;
+    return xpos;
+}
+
+#if PEAKDETECT_X86
+/**
+  @brief    check if the cpu we're running on can do sse2
+  **/
+static bool cpuHasSSE2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+}
+
+/**
+  @brief    sse2 arg max; 4 lanes each keeping their first maximum, merged at the end
+  **/
+__attribute__((target("sse2")))
+static int peakArgMaxSSE2(const float *row, int from, int to, float *power)
+{
+    __m128  vmax = _mm_setzero_ps();
+    __m128i vidx = _mm_set1_epi32(from);
+    __m128i vcur = _mm_setr_epi32(from, from + 1, from + 2, from + 3);
+    const __m128i four = _mm_set1_epi32(4);
+
+    int x = from;
+    for (; x <= to - 4; x += 4) {
+        __m128 v = _mm_loadu_ps(row + x);
+        __m128 gt = _mm_cmpgt_ps(v, vmax);     //strictly greater: keep first occurrence per lane
+        vmax = _mm_or_ps(_mm_and_ps(gt, v), _mm_andnot_ps(gt, vmax));
+        __m128i gti = _mm_castps_si128(gt);
+        vidx = _mm_or_si128(_mm_and_si128(gti, vcur), _mm_andnot_si128(gti, vidx));
+        vcur = _mm_add_epi32(vcur, four);
+    }
+
+    float m[4];
+    int   idx[4];
+    _mm_storeu_ps(m, vmax);
+    _mm_storeu_si128((__m128i*) idx, vidx);
+
+    //merge lanes: largest value, smallest index among equals; lanes without hit hold 0 at 'from'
+    float p = 0;
+    int xpos = from;
+    for (int i = 0; i < 4; i++) {
+        if (m[i] > p || (m[i] == p && m[i] > 0 && idx[i] < xpos)) {
+            p = m[i];
+            xpos = idx[i];
+        }
+    }
+    for (; x < to; x++) {   //tail
+        if (row[x] > p) {
+            p = row[x];
+            xpos = x;
+        }
+    }
+    *power = p;
+    return xpos;
+}
+#endif // PEAKDETECT_X86
+
+/**
+  @brief    find first maximum of row within [from, to)
+  @param    row     row data
+  @param    from    first index to search
+  @param    to      one past last index to search
+  @param    power   output: value of the maximum; 0 if there is no positive value
+  @return   index of the first maximum; from if there is no positive value
+  **/
+int peakArgMax(const float *row, int from, int to, float *power)
+{
+#if PEAKDETECT_X86
+    static const bool sse2 = cpuHasSSE2();     //initialized once and thread safe (gcc/clang guard local statics); called from openmp loops
+    if (sse2)
+        return peakArgMaxSSE2(row, from, to, power);
+#endif
+    return peakArgMaxScalar(row, from, to, power);
+}
+
+/**
+  @brief    refine integer maximum to sub-pixel position
+  @param    row     row data
+  @param    width   number of values in row
+  @param    xpos    integer position of the maximum
+  @param    method  one of SUBPIXEL_*
+  @return   sub-pixel position; xpos if the estimator can't be applied (border, flat or non-peak data)
+  **/
+float peakRefine(const float *row, int width, int xpos, int method)
+{
+    if (method == SUBPIXEL_NONE || xpos < 0 || xpos >= width)
+        return float(xpos);
+
+    if (method == SUBPIXEL_COG) {
+        int from = xpos - SUBPIXEL_COG_HALFWINDOW;
+        int to = xpos + SUBPIXEL_COG_HALFWINDOW;
+        if (from < 0)
+            from = 0;
+        if (to > width - 1)
+            to = width - 1;
+        float sum = 0;
+        float moment = 0;
+        for (int x = from; x <= to; x++) {
+            sum += row[x];
+            moment += row[x] * float(x - xpos);
+        }
+        if (sum <= 0)
+            return float(xpos);
+        return float(xpos) + moment / sum;
+    }
+
+    //three point estimators
+    if (xpos < 1 || xpos > width - 2)
+        return float(xpos);
+    float l = row[xpos - 1];
+    float c = row[xpos];
+    float r = row[xpos + 1];
+    float delta;
+
+    if (method == SUBPIXEL_GAUSS && l > 0 && c > 0 && r > 0) {
+        l = logf(l);
+        c = logf(c);
+        r = logf(r);
+    } else if (method != SUBPIXEL_PARABOLA && method != SUBPIXEL_GAUSS) {
+        return float(xpos);
+    }   //gauss on non-positive data falls back to parabola
+
+    float denom = l - 2.0f * c + r;
+    if (denom >= 0)     //not a maximum (flat or convex)
+        return float(xpos);
+    delta = 0.5f * (l - r) / denom;
+    if (delta > 0.5f)
+        delta = 0.5f;
+    if (delta < -0.5f)
+        delta = -0.5f;
+    return float(xpos) + delta;
+}
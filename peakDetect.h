@@ -0,0 +1,23 @@
+/**
+  @file     peakDetect.h
+  @brief    laser line peak search within one image row
+
+  The integer maximum is found by a vectorized arg max; the estimators then refine it to
+  sub-pixel precision from a few samples around it, which costs next to nothing on top.
+  **/
+
+#ifndef PEAKDETECT_H
+#define PEAKDETECT_H
+
+//sub-pixel estimators
+#define SUBPIXEL_NONE           0       ///< integer position of the maximum
+#define SUBPIXEL_COG            1       ///< centre of gravity within a window around the maximum
+#define SUBPIXEL_PARABOLA       2       ///< vertex of parabola through maximum and its neighbours
+#define SUBPIXEL_GAUSS          3       ///< vertex of gaussian through maximum and its neighbours
+
+#define SUBPIXEL_COG_HALFWINDOW 3       ///< centre of gravity uses maximum +- this many pixels
+
+int   peakArgMax(const float *row, int from, int to, float *power);
+float peakRefine(const float *row, int width, int xpos, int method);
+
+#endif // PEAKDETECT_H
@@ -0,0 +1,71 @@
+#include "pointCloud.h"
+
+PointCloud::PointCloud()
+{
+    m_bNormals = false;
+}
+
+/**
+  @brief    remove all points; memory is kept
+  **/
+void PointCloud::clear()
+{
+    m_xyz.clear();
+    m_normals.clear();
+}
+
+/**
+  @brief    preallocate for a number of points
+  **/
+void PointCloud::reserve(size_t points)
+{
+    m_xyz.reserve(3 * points);
+    if (m_bNormals)
+        m_normals.reserve(3 * points);
+}
+
+/**
+  @brief    store normals or not; points already stored get normal (0,0,0)
+  **/
+void PointCloud::setHasNormals(bool normals)
+{
+    m_bNormals = normals;
+    if (normals)
+        m_normals.resize(m_xyz.size(), 0.0f);
+    else
+        std::vector<float>().swap(m_normals);
+}
+
+/**
+  @brief    number of points
+  **/
+size_t PointCloud::size() const
+{
+    return m_xyz.size() / 3;
+}
+
+bool PointCloud::isEmpty() const
+{
+    return m_xyz.empty();
+}
+
+bool PointCloud::hasNormals() const
+{
+    return m_bNormals;
+}
+
+/**
+  @brief    interleaved coordinates, 3 * size() floats
+  **/
+const float* PointCloud::points() const
+{
+    return m_xyz.empty() ? NULL : &m_xyz[0];
+}
+
+/**
+  @brief    interleaved normals, 3 * size() floats; NULL without normals
+  **/
+const float* PointCloud::normals() const
+{
+    return m_normals.empty() ? NULL : &m_normals[0];
+}
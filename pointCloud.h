@@ -0,0 +1,50 @@
+#ifndef POINTCLOUD_H
+#define POINTCLOUD_H
+
+#include <vector>
+#include <QtGlobal>
+
+/**
+  @class    PointCloud  unorganized list of 3D points with optional normals, ready for export
+
+  Coordinates are kept interleaved (x, y, z per point) in one contiguous float array, so writers can
+  dump them with a single copy per buffer.
+  **/
+class PointCloud
+{
+public:
+    PointCloud();
+
+    void            clear();
+    void            reserve(size_t points);
+    void            setHasNormals(bool normals);
+
+    /** @brief  append a point; normal (0,0,0) if the cloud has normals **/
+    inline void     append(const float *xyz)
+    {
+        m_xyz.insert(m_xyz.end(), xyz, xyz + 3);
+        if (m_bNormals)
+            m_normals.insert(m_normals.end(), 3, 0.0f);
+    }
+
+    /** @brief  append a point with normal; the normal is dropped if the cloud has none **/
+    inline void     append(const float *xyz, const float *normal)
+    {
+        m_xyz.insert(m_xyz.end(), xyz, xyz + 3);
+        if (m_bNormals)
+            m_normals.insert(m_normals.end(), normal, normal + 3);
+    }
+
+    size_t          size() const;
+    bool            isEmpty() const;
+    bool            hasNormals() const;
+    const float*    points() const;
+    const float*    normals() const;
+
+private:
+    std::vector<float>  m_xyz;          ///< x, y, z per point
+    std::vector<float>  m_normals;      ///< nx, ny, nz per point; empty without normals
+    bool                m_bNormals;     ///< normals are stored
+};
+
+#endif // POINTCLOUD_H
@@ -0,0 +1,272 @@
+#include "pointCloudWriter.h"
+#include "QtException.h"
+#include <QFileInfo>
+#include <QByteArray>
+#include <string.h>
+
+#if defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+#define CLOUDWRITER_MAX_FLOAT_CHARS 24      ///< upper bound of one formatted float plus separator
+
+/**
+  @brief    format a float with the fewest digits that read back to the same value
+  @return   end of the written characters
+  **/
+static inline char* formatFloat(char *p, float v)
+{
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    return std::to_chars(p, p + CLOUDWRITER_MAX_FLOAT_CHARS, v).ptr;
+#else
+    QByteArray text = QByteArray::number(double(v), 'g', 9);    //C locale; 9 significant digits always round trip
+    memcpy(p, text.constData(), size_t(text.size()));
+    return p + text.size();
+#endif
+}
+
+PointCloudWriter::PointCloudWriter()
+{
+    m_iFormat = CLOUD_FORMAT_PLY;
+    m_bNormals = false;
+    m_iUsed = 0;
+    m_nPoints = 0;
+    m_iCountPos[0] = m_iCountPos[1] = -1;
+    m_bError = false;
+}
+
+/**
+  @brief    cleaning up destructor; an open file is finished
+  **/
+PointCloudWriter::~PointCloudWriter()
+{
+    close();
+}
+
+/**
+  @brief    guess the format from a file's suffix
+  @return   CLOUD_FORMAT_*; -1 if unknown
+  **/
+int PointCloudWriter::formatFromFileName(const QString &fileName)
+{
+    QString suffix = QFileInfo(fileName).suffix().toLower();
+    if (suffix == "ply")
+        return CLOUD_FORMAT_PLY;
+    if (suffix == "pcd")
+        return CLOUD_FORMAT_PCD;
+    if (suffix == "xyz" || suffix == "txt")
+        return CLOUD_FORMAT_XYZ;
+    return -1;
+}
+
+/**
+  @brief    write a whole cloud into a file
+  @param    format  CLOUD_FORMAT_*; -1 to choose by suffix
+  **/
+bool PointCloudWriter::save(const QString &fileName, const PointCloud &cloud, int format /*= -1*/)
+{
+    if (format < 0)
+        format = formatFromFileName(fileName);
+    if (format < 0) {
+        DEBUG(1, QString("Unknown point cloud format of %1").arg(fileName));
+        return false;
+    }
+    PointCloudWriter writer;
+    if (!writer.open(fileName, format, cloud.hasNormals()))
+        return false;
+    writer.write(cloud);
+    return writer.close();
+}
+
+/**
+  @brief    start a new file and write its header
+  @param    fileName    file to (over)write
+  @param    format      CLOUD_FORMAT_*
+  @param    normals     points carry normals
+  **/
+bool PointCloudWriter::open(const QString &fileName, int format, bool normals)
+{
+    close();
+    m_iFormat = format;
+    m_bNormals = normals;
+    m_iUsed = 0;
+    m_nPoints = 0;
+    m_iCountPos[0] = m_iCountPos[1] = -1;
+    m_bError = false;
+    m_file.setFileName(fileName);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        DEBUG(1, QString("Could not open %1 for writing").arg(fileName));
+        return false;
+    }
+    m_buffer.resize(CLOUDWRITER_BUFFER_SIZE);
+    writeHeader();
+    return true;
+}
+
+/**
+  @brief    header of the chosen format; point counts are placeholders, remembered in m_iCountPos
+  **/
+void PointCloudWriter::writeHeader()
+{
+    QByteArray header;
+    QByteArray count = QByteArray(CLOUDWRITER_COUNT_DIGITS, '0');
+    int countAt[2] = {-1, -1};
+    if (m_iFormat == CLOUD_FORMAT_PLY) {
+        header = "ply\n";
+        header += (Q_BYTE_ORDER == Q_LITTLE_ENDIAN) ? "format binary_little_endian 1.0\n" : "format binary_big_endian 1.0\n";
+        header += "element vertex ";
+        countAt[0] = header.size();
+        header += count + "\n";
+        header += "property float x\nproperty float y\nproperty float z\n";
+        if (m_bNormals)
+            header += "property float nx\nproperty float ny\nproperty float nz\n";
+        header += "end_header\n";
+    } else if (m_iFormat == CLOUD_FORMAT_PCD) {
+        header = "# .PCD v0.7 - Point Cloud Data file format\nVERSION 0.7\n";
+        if (m_bNormals)
+            header += "FIELDS x y z normal_x normal_y normal_z\nSIZE 4 4 4 4 4 4\nTYPE F F F F F F\nCOUNT 1 1 1 1 1 1\n";
+        else
+            header += "FIELDS x y z\nSIZE 4 4 4\nTYPE F F F\nCOUNT 1 1 1\n";
+        header += "WIDTH ";
+        countAt[0] = header.size();
+        header += count + "\nHEIGHT 1\nVIEWPOINT 0 0 0 1 0 0 0\nPOINTS ";
+        countAt[1] = header.size();
+        header += count + "\nDATA binary\n";
+    }
+    for (int i = 0; i < 2; i++)
+        m_iCountPos[i] = countAt[i];    //header starts at file offset 0
+    if (!header.isEmpty())
+        memcpy(reserve(header.size()), header.constData(), header.size());
+}
+
+/**
+  @brief    get room for bytes in the output buffer, flushing it if necessary
+  **/
+char* PointCloudWriter::reserve(size_t bytes)
+{
+    if (m_iUsed + bytes > m_buffer.size()) {
+        flush();
+        if (bytes > m_buffer.size())
+            m_buffer.resize(bytes);
+    }
+    char *p = &m_buffer[m_iUsed];
+    m_iUsed += bytes;
+    return p;
+}
+
+/**
+  @brief    write out the buffer
+  **/
+bool PointCloudWriter::flush()
+{
+    if (m_iUsed > 0 && m_file.write(&m_buffer[0], qint64(m_iUsed)) != qint64(m_iUsed)) {
+        if (!m_bError)
+            DEBUG(1, QString("Write error on %1").arg(m_file.fileName()));
+        m_bError = true;
+    }
+    m_iUsed = 0;
+    return !m_bError;
+}
+
+/**
+  @brief    append points
+  @param    xyz         3 * count interleaved coordinates
+  @param    normals     3 * count interleaved normals; ignored if the file has none, (0,0,0) written if NULL
+  @param    count       number of points
+  **/
+bool PointCloudWriter::write(const float *xyz, const float *normals, size_t count)
+{
+    if (!m_file.isOpen())
+        return false;
+    static const float noNormal[3] = {0.0f, 0.0f, 0.0f};
+    const int floats = m_bNormals ? 6 : 3;
+
+    if (m_iFormat == CLOUD_FORMAT_XYZ) {
+        for (size_t i = 0; i < count; i++) {
+            char *start = reserve(floats * CLOUDWRITER_MAX_FLOAT_CHARS);
+            char *p = start;
+            const float *v = xyz + 3 * i;
+            p = formatFloat(p, v[0]); *p++ = ' ';
+            p = formatFloat(p, v[1]); *p++ = ' ';
+            p = formatFloat(p, v[2]);
+            if (m_bNormals) {
+                const float *n = normals ? normals + 3 * i : noNormal;
+                *p++ = ' '; p = formatFloat(p, n[0]);
+                *p++ = ' '; p = formatFloat(p, n[1]);
+                *p++ = ' '; p = formatFloat(p, n[2]);
+            }
+            *p++ = '\n';
+            m_iUsed -= (floats * CLOUDWRITER_MAX_FLOAT_CHARS) - (p - start);    //give back what wasn't used
+        }
+    } else if (!m_bNormals) {   //binary, same layout as in memory
+        const char *src = (const char*) xyz;
+        size_t bytes = 3 * sizeof(float) * count;
+        while (bytes > 0) {
+            size_t chunk = qMin(bytes, m_buffer.size() - m_iUsed);
+            if (chunk == 0) {
+                flush();
+                continue;
+            }
+            memcpy(reserve(chunk), src, chunk);
+            src += chunk;
+            bytes -= chunk;
+        }
+    } else {                    //binary, interleave normals
+        for (size_t i = 0; i < count; i++) {
+            float *p = (float*) reserve(6 * sizeof(float));
+            memcpy(p, xyz + 3 * i, 3 * sizeof(float));
+            memcpy(p + 3, normals ? normals + 3 * i : noNormal, 3 * sizeof(float));
+        }
+    }
+    m_nPoints += count;
+    return !m_bError;
+}
+
+/**
+  @brief    append all points of a cloud
+  **/
+bool PointCloudWriter::write(const PointCloud &cloud)
+{
+    if (cloud.isEmpty())
+        return !m_bError;
+    return write(cloud.points(), cloud.normals(), cloud.size());
+}
+
+/**
+  @brief    flush, patch the point counts into the header and close
+  @return   false if anything went wrong since open()
+  **/
+bool PointCloudWriter::close()
+{
+    if (!m_file.isOpen())
+        return false;
+    flush();
+    QByteArray count = QByteArray::number(m_nPoints).rightJustified(CLOUDWRITER_COUNT_DIGITS, '0');
+    if (count.size() > CLOUDWRITER_COUNT_DIGITS) {
+        DEBUG(1, "Too many points for the header");
+        m_bError = true;
+    }
+    for (int i = 0; i < 2 && !m_bError; i++) {
+        if (m_iCountPos[i] < 0)
+            continue;
+        if (!m_file.seek(m_iCountPos[i]) || m_file.write(count) != count.size())
+            m_bError = true;
+    }
+    m_file.close();
+    return !m_bError;
+}
+
+bool PointCloudWriter::isOpen()
+{
+    return m_file.isOpen();
+}
+
+/**
+  @brief    number of points written since open()
+  **/
+quint64 PointCloudWriter::pointsWritten()
+{
+    return m_nPoints;
+}
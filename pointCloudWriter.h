@@ -0,0 +1,57 @@
+#ifndef POINTCLOUDWRITER_H
+#define POINTCLOUDWRITER_H
+
+#include <vector>
+#include <QFile>
+#include <QString>
+#include "pointCloud.h"
+
+//export file formats
+#define CLOUD_FORMAT_PLY            0       ///< binary PLY, native byte order
+#define CLOUD_FORMAT_PCD            1       ///< binary PCD v0.7
+#define CLOUD_FORMAT_XYZ            2       ///< ascii x y z [nx ny nz] per line
+
+#define CLOUDWRITER_BUFFER_SIZE     (1 << 20)   ///< bytes collected before each file write
+#define CLOUDWRITER_COUNT_DIGITS    10          ///< fixed width of point counts in headers, patched by close()
+
+
+/**
+  @class    PointCloudWriter    buffered streaming writer for point cloud files
+
+  Points may be written in any number of chunks; the point count in PLY/PCD headers is written as a
+  zero padded placeholder and patched when the file is closed, so the total needn't be known up front.
+  Binary formats copy the floats as they are; ascii output uses shortest round trip formatting.
+  **/
+class PointCloudWriter
+{
+public:
+    PointCloudWriter();
+    virtual ~PointCloudWriter();
+
+    bool        open(const QString &fileName, int format, bool normals);
+    bool        write(const float *xyz, const float *normals, size_t count);
+    bool        write(const PointCloud &cloud);
+    bool        close();
+    bool        isOpen();
+    quint64     pointsWritten();
+
+    static int  formatFromFileName(const QString &fileName);
+    static bool save(const QString &fileName, const PointCloud &cloud, int format = -1);
+
+private:
+    void        writeHeader();
+    char*       reserve(size_t bytes);
+    bool        flush();
+
+private:
+    QFile               m_file;             ///< output file
+    int                 m_iFormat;          ///< CLOUD_FORMAT_*
+    bool                m_bNormals;         ///< points carry normals
+    std::vector<char>   m_buffer;           ///< output buffer
+    size_t              m_iUsed;            ///< bytes used in m_buffer
+    quint64             m_nPoints;          ///< points written so far
+    qint64              m_iCountPos[2];     ///< file offsets of the point count placeholders; -1 if unused
+    bool                m_bError;           ///< a write failed, the file is incomplete
+};
+
+#endif // POINTCLOUDWRITER_H
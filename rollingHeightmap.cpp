@@ -0,0 +1,183 @@
+#include "rollingHeightmap.h"
+#include "QtException.h"
+#include <algorithm>
+#include <limits>
+#include <string.h>
+
+#define ROLLING_UNCHANGED   std::numeric_limits<qint64>::max()  ///< m_iChangedFrom if no row was begun
+
+RollingHeightmap::RollingHeightmap()
+{
+    m_iCapacity = 1;
+    m_iColumns = 0;
+    m_bEmpty = true;
+    m_iOldest = 0;
+    m_iNewest = -1;
+    m_iChangedFrom = ROLLING_UNCHANGED;
+}
+
+/**
+  @brief    (re)allocate; all rows are cleared
+  @param    capacity    number of rows kept
+  @param    columns     samples per row
+  **/
+void RollingHeightmap::create(int capacity, int columns)
+{
+    if (capacity < 1 || columns < 0) {
+        EX_THROW("RollingHeightmap: invalid size");
+    }
+    m_iCapacity = capacity;
+    m_iColumns = columns;
+    m_height.assign(size_t(capacity) * columns, 0.0f);
+    m_power.assign(size_t(capacity) * columns, 0.0f);
+    m_bEmpty = true;
+    m_iOldest = 0;
+    m_iNewest = -1;
+    DEBUG(10, QString("Allocated rolling heightmap %1x%2, %3 bytes").arg(columns).arg(capacity).arg(bytes()));
+}
+
+/**
+  @brief    free all rows
+  **/
+void RollingHeightmap::release()
+{
+    std::vector<float>().swap(m_height);
+    std::vector<float>().swap(m_power);
+    m_iCapacity = 1;
+    m_iColumns = 0;
+    m_bEmpty = true;
+    m_iOldest = 0;
+    m_iNewest = -1;
+}
+
+/**
+  @brief    remove all rows, keep capacity; the next beginRow starts anew at any position
+  **/
+void RollingHeightmap::clear()
+{
+    std::fill(m_height.begin(), m_height.end(), 0.0f);
+    std::fill(m_power.begin(), m_power.end(), 0.0f);
+    m_bEmpty = true;
+    m_iOldest = 0;
+    m_iNewest = -1;
+}
+
+/**
+  @brief    memory used by the rows
+  **/
+quint64 RollingHeightmap::bytes() const
+{
+    return quint64(m_height.size() + m_power.size()) * sizeof(float);
+}
+
+/**
+  @brief    empty one ring row
+  **/
+void RollingHeightmap::clearSlot(int slot)
+{
+    std::fill(m_height.begin() + size_t(slot) * m_iColumns, m_height.begin() + size_t(slot + 1) * m_iColumns, 0.0f);
+    std::fill(m_power.begin() + size_t(slot) * m_iColumns, m_power.begin() + size_t(slot + 1) * m_iColumns, 0.0f);
+}
+
+/**
+  @brief    make the row at position writable
+  @param    position    frame counter or encoder count
+  @return   false if position is older than the oldest kept row
+
+  A new position beyond the newest one advances the ring: rows in between are emptied, the oldest ones dropped.
+  A position already kept (standing belt, encoder jitter) is written into again.
+  **/
+bool RollingHeightmap::beginRow(qint64 position)
+{
+    if (m_iColumns == 0 || m_height.empty())
+        return false;
+    if (m_bEmpty) {
+        clearSlot(slot(position));
+        m_iOldest = m_iNewest = position;
+        m_bEmpty = false;
+        m_iChangedFrom = qMin(m_iChangedFrom, position);
+        return true;
+    }
+    if (position <= m_iNewest) {
+        if (position < m_iOldest)
+            return false;
+        m_iChangedFrom = qMin(m_iChangedFrom, position);
+        return true;
+    }
+
+    if (position - m_iNewest >= m_iCapacity) {  //jumped past everything kept
+        std::fill(m_height.begin(), m_height.end(), 0.0f);
+        std::fill(m_power.begin(), m_power.end(), 0.0f);
+    } else {
+        for (qint64 p = m_iNewest + 1; p <= position; p++) {
+            clearSlot(slot(p));
+        }
+    }
+    m_iChangedFrom = qMin(m_iChangedFrom, m_iNewest + 1);     //emptied rows are changes, too
+    m_iNewest = position;
+    m_iOldest = qMax(m_iOldest, m_iNewest - m_iCapacity + 1);
+    return true;
+}
+
+/**
+  @brief    get rows in place
+  @param    firstPosition   first wanted row
+  @param    count           number of wanted rows
+  @param    segments        output: up to two segments, in position order
+  @return   number of segments filled; rows not kept are left out
+  **/
+int RollingHeightmap::window(qint64 firstPosition, int count, RollingSegment *segments) const
+{
+    if (m_bEmpty || count <= 0)
+        return 0;
+    qint64 first = qMax(firstPosition, m_iOldest);
+    qint64 end = qMin(firstPosition + count, m_iNewest + 1);
+    if (first >= end)
+        return 0;
+
+    int n = 0;
+    while (first < end) {
+        int s = slot(first);
+        int rows = int(qMin(end - first, qint64(m_iCapacity - s)));
+        segments[n].firstPosition = first;
+        segments[n].rows = rows;
+        segments[n].height = &m_height[size_t(s) * m_iColumns];
+        segments[n].power = &m_power[size_t(s) * m_iColumns];
+        ++n;
+        first += rows;
+    }
+    return n;
+}
+
+/**
+  @brief    bring a copy up to date, copying only the rows begun since the last call
+  @param    copy    map to update; only one copy can be kept up to date this way
+
+  The copy is reallocated if capacity or columns differ, then gets all kept rows. Otherwise rows keep
+  their ring slots in both maps, so rows the copy already has stay where they are. Rows outside the kept
+  range are never read, so clear() and create() need nothing but the new range.
+  **/
+void RollingHeightmap::copyChangesTo(RollingHeightmap *copy)
+{
+    qint64 from = m_iChangedFrom;
+    if (copy->m_iCapacity != m_iCapacity || copy->m_iColumns != m_iColumns || copy->m_height.size() != m_height.size()) {
+        copy->create(m_iCapacity, m_iColumns);
+        from = m_iOldest;
+    }
+    copy->m_bEmpty = m_bEmpty;
+    copy->m_iOldest = m_iOldest;
+    copy->m_iNewest = m_iNewest;
+    m_iChangedFrom = ROLLING_UNCHANGED;
+    if (m_bEmpty || from > m_iNewest)
+        return;
+
+    from = qMax(from, m_iOldest);
+    RollingSegment segments[2];
+    int n = window(from, int(m_iNewest - from + 1), segments);
+    for (int i = 0; i < n; i++) {
+        size_t offset = size_t(slot(segments[i].firstPosition)) * m_iColumns;
+        size_t count = size_t(segments[i].rows) * m_iColumns;
+        memcpy(&copy->m_height[offset], segments[i].height, count * sizeof(float));
+        memcpy(&copy->m_power[offset], segments[i].power, count * sizeof(float));
+    }
+}
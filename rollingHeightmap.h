@@ -0,0 +1,95 @@
+#ifndef ROLLINGHEIGHTMAP_H
+#define ROLLINGHEIGHTMAP_H
+
+#include <vector>
+#include <QtGlobal>
+
+#define ROLLING_DEFAULT_CAPACITY    2048    ///< default number of profile rows kept
+
+
+/**
+  @struct   RollingSegment  contiguous run of rows inside a RollingHeightmap
+  **/
+struct RollingSegment
+{
+    qint64          firstPosition;  ///< position of the first row
+    int             rows;           ///< number of rows
+    const float*    height;         ///< rows * columns heights, row major
+    const float*    power;          ///< rows * columns powers, row major; 0: no sample
+};
+
+
+/**
+  @class    RollingHeightmap    circular heightmap for continuous (conveyor) scanning
+
+  Each row holds one profile and is addressed by an ever increasing position, e.g. a frame counter
+  or an encoder count. Only the newest capacity() positions are kept; advancing further
+  overwrites the oldest rows. Positions skipped by the clock stay empty.
+
+  Consumers read rows in place: window() hands out at most two contiguous segments (the ring may wrap),
+  no data is copied.
+
+  Different columns of a row may be written concurrently; beginRow() must be serial. Reading from
+  another thread while rows are written or the map is recreated needs a lock or a copy, see
+  CameraThread::rollingSnapshot(). copyChangesTo() keeps one such copy up to date by copying only the
+  rows begun since its last call.
+  **/
+class RollingHeightmap
+{
+public:
+    RollingHeightmap();
+
+    void    create(int capacity, int columns);
+    void    release();
+    void    clear();
+
+    int     capacity() const        { return m_iCapacity; }
+    int     columns() const         { return m_iColumns; }
+    bool    isEmpty() const         { return m_bEmpty; }
+    qint64  oldestPosition() const  { return m_iOldest; }
+    qint64  newestPosition() const  { return m_iNewest; }
+    quint64 bytes() const;
+
+    /** @brief  true if the row at position is kept **/
+    bool    contains(qint64 position) const {
+        return !m_bEmpty && position >= m_iOldest && position <= m_iNewest;
+    }
+    /** @brief  height at (position, col); 0 if the row isn't kept **/
+    float   height(qint64 position, int col) const {
+        return contains(position) ? m_height[slot(position) * m_iColumns + col] : 0.0f;
+    }
+    /** @brief  power at (position, col); 0 if there is no sample **/
+    float   power(qint64 position, int col) const {
+        return contains(position) ? m_power[slot(position) * m_iColumns + col] : 0.0f;
+    }
+    /** @brief  store a sample; the row must be kept **/
+    void    set(qint64 position, int col, float height, float power) {
+        int i = slot(position) * m_iColumns + col;
+        m_height[i] = height;
+        m_power[i] = power;
+    }
+
+    bool    beginRow(qint64 position);
+    int     window(qint64 firstPosition, int count, RollingSegment *segments) const;
+    void    copyChangesTo(RollingHeightmap *copy);
+
+private:
+    /** @brief  ring index of a position **/
+    int     slot(qint64 position) const {
+        qint64 s = position % m_iCapacity;
+        return int((s < 0) ? s + m_iCapacity : s);
+    }
+    void    clearSlot(int slot);
+
+private:
+    int                 m_iCapacity;    ///< number of rows kept
+    int                 m_iColumns;     ///< samples per row (line roi rows)
+    std::vector<float>  m_height;       ///< capacity * columns heights
+    std::vector<float>  m_power;        ///< capacity * columns powers
+    bool                m_bEmpty;       ///< no row started yet
+    qint64              m_iOldest;      ///< oldest kept position
+    qint64              m_iNewest;      ///< newest started position
+    qint64              m_iChangedFrom; ///< oldest position begun since the last copyChangesTo
+};
+
+#endif // ROLLINGHEIGHTMAP_H
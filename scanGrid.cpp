@@ -0,0 +1,345 @@
+#include "scanGrid.h"
+#include "QtException.h"
+#include <algorithm>
+
+ScanGrid::ScanGrid()
+{
+    m_iRows = 0;
+    m_iColumns = 0;
+    m_iHeightFormat = SCANGRID_HEIGHT_FIXED16;
+    m_bValidity = true;
+    m_bGrowable = false;
+    m_iFirstTile = 0;
+    m_iGeneration = 0;
+    m_iResetEpoch = 0;
+}
+
+ScanGrid::ScanGrid(int rows, int columns, int heightFormat /*= SCANGRID_HEIGHT_FIXED16*/, bool validity /*= true*/)
+{
+    m_iRows = 0;
+    m_iColumns = 0;
+    m_iHeightFormat = SCANGRID_HEIGHT_FIXED16;
+    m_bValidity = true;
+    m_bGrowable = false;
+    m_iFirstTile = 0;
+    m_iGeneration = 0;
+    m_iResetEpoch = 0;
+    create(rows, columns, heightFormat, validity);
+}
+
+/**
+  @brief    cleaning up destructor
+  **/
+ScanGrid::~ScanGrid()
+{
+    release();
+}
+
+/**
+  @brief    set up a bounded grid; all samples are cleared, tiles are allocated on demand
+  @param    rows            number of slider positions
+  @param    columns         number of line roi rows
+  @param    heightFormat    SCANGRID_HEIGHT_FLOAT or SCANGRID_HEIGHT_FIXED16
+  @param    validity        keep a validity bitmap
+  **/
+void ScanGrid::create(int rows, int columns, int heightFormat /*= SCANGRID_HEIGHT_FIXED16*/, bool validity /*= true*/)
+{
+    if (rows < 0 || columns < 0) {
+        EX_THROW("ScanGrid: negative size");
+    }
+    release();
+    m_iRows = rows;
+    m_iColumns = columns;
+    m_iHeightFormat = heightFormat;
+    m_bValidity = validity;
+    m_bGrowable = false;
+}
+
+/**
+  @brief    set up a growable grid; all samples are cleared
+  @param    columns         number of line roi rows
+  @param    heightFormat    SCANGRID_HEIGHT_FLOAT or SCANGRID_HEIGHT_FIXED16
+  @param    validity        keep a validity bitmap
+  **/
+void ScanGrid::createGrowable(int columns, int heightFormat /*= SCANGRID_HEIGHT_FIXED16*/, bool validity /*= true*/)
+{
+    if (columns < 0) {
+        EX_THROW("ScanGrid: negative size");
+    }
+    release();
+    m_iColumns = columns;
+    m_iHeightFormat = heightFormat;
+    m_bValidity = validity;
+    m_bGrowable = true;
+}
+
+/**
+  @brief    free all tiles; geometry is reset
+  **/
+void ScanGrid::release()
+{
+    clear();
+    m_iRows = 0;
+    m_iColumns = 0;
+    m_lineRoi = QRect();
+}
+
+/**
+  @brief    remove all samples and free their tiles, keep geometry
+  **/
+void ScanGrid::clear()
+{
+    for (size_t i = 0; i < m_tiles.size(); i++) {
+        delete m_tiles[i];
+    }
+    std::vector<ScanTile*>().swap(m_tiles);
+    m_iFirstTile = 0;
+    ++m_iGeneration;
+    ++m_iResetEpoch;
+}
+
+/**
+  @brief    first row of the grid's extent: 0 if bounded, else first row of the first allocated tile
+  **/
+int ScanGrid::firstRow() const
+{
+    if (!m_bGrowable)
+        return 0;
+    return tileFirstRow(m_iFirstTile);
+}
+
+/**
+  @brief    row after the grid's extent: number of rows if bounded, else end of the last allocated tile
+  **/
+int ScanGrid::endRow() const
+{
+    if (!m_bGrowable)
+        return m_iRows;
+    return tileFirstRow(m_iFirstTile + int(m_tiles.size()));
+}
+
+/**
+  @brief    allocate an empty tile
+  **/
+ScanTile* ScanGrid::newTile()
+{
+    ScanTile *t = new ScanTile;
+    t->generation = ++m_iGeneration;
+    size_t n = size_t(SCANGRID_TILE_ROWS) * m_iColumns;
+    if (m_iHeightFormat == SCANGRID_HEIGHT_FLOAT) {
+        t->heightF.assign(n, 0.0f);
+    } else {
+        t->heightQ.assign(n, 0);
+    }
+    t->power.assign(n, 0);
+    if (m_bValidity) {
+        t->valid.assign(m_iColumns, 0);
+    }
+    return t;
+}
+
+/**
+  @brief    make sure rows from .. to (inclusive) have tiles; rows outside a bounded grid are ignored
+  @return   false if none of the rows can hold samples
+  **/
+bool ScanGrid::prepareRows(int from, int to)
+{
+    if (!m_bGrowable) {
+        from = qMax(from, 0);
+        to = qMin(to, m_iRows - 1);
+    }
+    if (from > to || m_iColumns == 0)
+        return false;
+
+    int first = from >> SCANGRID_TILE_SHIFT;
+    int last = to >> SCANGRID_TILE_SHIFT;
+    if (m_tiles.empty()) {
+        m_iFirstTile = first;
+    }
+    if (first < m_iFirstTile) {     //grow towards smaller rows
+        m_tiles.insert(m_tiles.begin(), m_iFirstTile - first, (ScanTile*) NULL);
+        m_iFirstTile = first;
+    }
+    if (last >= m_iFirstTile + int(m_tiles.size())) {
+        m_tiles.resize(last - m_iFirstTile + 1, NULL);
+    }
+    for (int t = first; t <= last; t++) {
+        ScanTile *&tile = m_tiles[t - m_iFirstTile];
+        if (!tile)
+            tile = newTile();
+    }
+    return true;
+}
+
+/**
+  @brief    note that samples of rows from .. to (inclusive) were changed
+  **/
+void ScanGrid::touchRows(int from, int to)
+{
+    if (from > to)
+        return;
+    quint64 generation = ++m_iGeneration;
+    for (int t = from >> SCANGRID_TILE_SHIFT; t <= (to >> SCANGRID_TILE_SHIFT); t++) {
+        int i = t - m_iFirstTile;
+        if (i >= 0 && i < int(m_tiles.size()) && m_tiles[i])
+            m_tiles[i]->generation = generation;
+    }
+}
+
+/**
+  @brief    make this grid an exact copy of src, copying only tiles changed since the last copy
+  @param    src     grid to copy; must not be changed during the call
+
+  Tile buffers of this grid are reused, so refreshing a copy of the same grid doesn't allocate.
+  **/
+void ScanGrid::copyChangedFrom(const ScanGrid &src)
+{
+    bool reshaped = false;
+    if (m_iRows != src.m_iRows || m_iColumns != src.m_iColumns || m_iHeightFormat != src.m_iHeightFormat
+            || m_bValidity != src.m_bValidity || m_bGrowable != src.m_bGrowable
+            || m_iResetEpoch != src.m_iResetEpoch) {     //reshaped or cleared: nothing to reuse
+        clear();
+        reshaped = true;
+        m_iRows = src.m_iRows;
+        m_iColumns = src.m_iColumns;
+        m_iHeightFormat = src.m_iHeightFormat;
+        m_bValidity = src.m_bValidity;
+        m_bGrowable = src.m_bGrowable;
+    }
+    m_lineRoi = src.m_lineRoi;
+    if (!reshaped && m_iGeneration == src.m_iGeneration)
+        return;
+
+    std::vector<ScanTile*> tiles(src.m_tiles.size(), (ScanTile*) NULL);
+    for (size_t i = 0; i < src.m_tiles.size(); i++) {
+        const ScanTile *from = src.m_tiles[i];
+        if (!from)
+            continue;
+        ScanTile *to = NULL;
+        int own = src.m_iFirstTile + int(i) - m_iFirstTile;
+        if (own >= 0 && own < int(m_tiles.size())) {  //take over our tile at the same index
+            to = m_tiles[own];
+            m_tiles[own] = NULL;
+        }
+        if (!to)
+            to = new ScanTile;
+        if (to->generation != from->generation)
+            *to = *from;
+        tiles[i] = to;
+    }
+    for (size_t i = 0; i < m_tiles.size(); i++) {   //tiles src doesn't have
+        delete m_tiles[i];
+    }
+    m_tiles.swap(tiles);
+    m_iFirstTile = src.m_iFirstTile;
+    m_iGeneration = src.m_iGeneration;
+    m_iResetEpoch = src.m_iResetEpoch;
+}
+
+/**
+  @brief    memory used by tiles
+  **/
+quint64 ScanGrid::bytes() const
+{
+    quint64 sum = quint64(m_tiles.size()) * sizeof(ScanTile*);
+    for (size_t i = 0; i < m_tiles.size(); i++) {
+        const ScanTile *t = m_tiles[i];
+        if (t) {
+            sum += sizeof(ScanTile) + quint64(t->heightF.size()) * sizeof(float)
+                    + quint64(t->heightQ.size() + t->power.size()) * sizeof(quint16)
+                    + quint64(t->valid.size()) * sizeof(quint64);
+        }
+    }
+    return sum;
+}
+
+/**
+  @brief    get indices of all allocated tiles, ascending
+  **/
+void ScanGrid::tileIndices(std::vector<int> &indices) const
+{
+    indices.clear();
+    for (size_t i = 0; i < m_tiles.size(); i++) {
+        if (m_tiles[i])
+            indices.push_back(m_iFirstTile + int(i));
+    }
+}
+
+/**
+  @brief    get indices of tiles changed after a generation, ascending
+  @param    generation  e.g. generation() at the time a reader last looked
+  @param    indices     output
+
+  Tiles removed by clear() are not reported; a reader notices them by tileCount() shrinking.
+  **/
+void ScanGrid::tilesChangedSince(quint64 generation, std::vector<int> &indices) const
+{
+    indices.clear();
+    for (size_t i = 0; i < m_tiles.size(); i++) {
+        if (m_tiles[i] && m_tiles[i]->generation > generation)
+            indices.push_back(m_iFirstTile + int(i));
+    }
+}
+
+/**
+  @brief    number of allocated tiles
+  **/
+int ScanGrid::tileCount() const
+{
+    int n = 0;
+    for (size_t i = 0; i < m_tiles.size(); i++) {
+        if (m_tiles[i])
+            ++n;
+    }
+    return n;
+}
+
+/**
+  @brief    get tile by index
+  @return   tile covering rows tileFirstRow(tileIndex) ..; NULL if not allocated
+  **/
+const ScanTile* ScanGrid::tile(int tileIndex) const
+{
+    int t = tileIndex - m_iFirstTile;
+    return (t >= 0 && t < int(m_tiles.size())) ? m_tiles[t] : NULL;
+}
+
+/**
+  @brief    convert to 8.8 fixed point, saturating
+  **/
+quint16 ScanGrid::toFixed(float value)
+{
+    float q = value * SCANGRID_FIXED_ONE + 0.5f;
+    if (q <= 0.0f)
+        return 0;
+    if (q >= float(SCANGRID_FIXED_MAX))
+        return SCANGRID_FIXED_MAX;
+    return quint16(q);
+}
+
+/**
+  @brief    store a sample; its row must have been prepared
+  @param    row     slider position
+  @param    col     line roi row
+  @param    height  height, 0 .. 255 for fixed16 heights
+  @param    power   line power; stored as 8.8 fixed point
+  **/
+void ScanGrid::set(int row, int col, float height, float power)
+{
+    ScanTile *t = const_cast<ScanTile*>(tileOfRow(row));
+    if (!t) {
+        DEBUG(10, QString("ScanGrid: row %1 not prepared").arg(row));
+        return;
+    }
+    int r = row & (SCANGRID_TILE_ROWS - 1);
+    int i = r * m_iColumns + col;
+    if (m_iHeightFormat == SCANGRID_HEIGHT_FLOAT) {
+        t->heightF[i] = height;
+    } else {
+        t->heightQ[i] = toFixed(height);
+    }
+    t->power[i] = toFixed(power);
+    if (m_bValidity) {
+        t->valid[col] |= quint64(1) << r;
+    }
+}
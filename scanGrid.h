@@ -0,0 +1,149 @@
+#ifndef SCANGRID_H
+#define SCANGRID_H
+
+#include <vector>
+#include <QtGlobal>
+#include <QRect>
+
+//storage formats of the height plane
+#define SCANGRID_HEIGHT_FLOAT       0       ///< 32 bit float heights
+#define SCANGRID_HEIGHT_FIXED16     1       ///< 16 bit unsigned 8.8 fixed point heights (0 .. 255.996)
+
+#define SCANGRID_FIXED_ONE          256.0f  ///< 1.0 in 8.8 fixed point, used for fixed16 heights and power
+#define SCANGRID_FIXED_MAX          65535
+
+#define SCANGRID_TILE_SHIFT         6       ///< log2 of rows per tile
+#define SCANGRID_TILE_ROWS          (1 << SCANGRID_TILE_SHIFT)  ///< rows per tile; one validity word per column and tile
+
+
+/**
+  @struct   ScanTile    SCANGRID_TILE_ROWS consecutive rows of a ScanGrid, full width
+  **/
+struct ScanTile
+{
+    ScanTile() : generation(0) {}
+
+    quint64                 generation; ///< grid generation of the last change, see ScanGrid::touchRows
+    std::vector<float>      heightF;    ///< height plane, SCANGRID_HEIGHT_FLOAT
+    std::vector<quint16>    heightQ;    ///< height plane, SCANGRID_HEIGHT_FIXED16
+    std::vector<quint16>    power;      ///< power plane, 8.8 fixed point
+    std::vector<quint64>    valid;      ///< validity bitmap, one word per column; empty if disabled
+};
+
+
+/**
+  @class    ScanGrid    accumulated scan data: one height and power sample per (slider position, line roi row)
+
+  Structure of arrays: heights, powers and the optional validity bitmap are separate contiguous planes.
+  Rows are slider positions, columns are line roi rows, as in the former 64 bit 3 channel scan image.
+  Power is stored as 16 bit 8.8 fixed point and saturates at 255.996; a power of 0 means "no sample".
+
+  Rows are stored in tiles of SCANGRID_TILE_ROWS which are allocated on demand by prepareRows().
+  A bounded grid covers rows 0 .. rows()-1 like an image; a growable grid accepts any row, negative
+  ones included, so a long part can be scanned in one pass. Reading rows without a tile yields
+  empty samples.
+
+  The validity bitmap is stored column major, so updates of different columns never touch the same
+  word and columns may be written concurrently once their rows are prepared. Nothing else is thread safe;
+  in particular prepareRows() and clear() must not run concurrently with readers. Readers in other threads
+  get their own copy through copyChangedFrom(), see ScanPublisher.
+
+  Tiles carry the generation of their last change; generations are unique over the grid's lifetime,
+  so a copy can tell which tiles it has to refresh.
+  **/
+class ScanGrid
+{
+public:
+    ScanGrid();
+    ScanGrid(int rows, int columns, int heightFormat = SCANGRID_HEIGHT_FIXED16, bool validity = true);
+    virtual ~ScanGrid();
+
+    void    create(int rows, int columns, int heightFormat = SCANGRID_HEIGHT_FIXED16, bool validity = true);
+    void    createGrowable(int columns, int heightFormat = SCANGRID_HEIGHT_FIXED16, bool validity = true);
+    void    release();
+    void    clear();
+    bool    prepareRows(int from, int to);
+    void    touchRows(int from, int to);
+    void    copyChangedFrom(const ScanGrid &src);
+    /** @brief  bumped by every change of geometry, content (see touchRows) or tiles **/
+    quint64 generation() const      { return m_iGeneration; }
+    /** @brief  bumped by clear(), create() and createGrowable(): all earlier samples are gone **/
+    quint64 resetEpoch() const      { return m_iResetEpoch; }
+
+    int     rows() const            { return endRow() - firstRow(); }
+    int     columns() const         { return m_iColumns; }
+    int     firstRow() const;
+    int     endRow() const;
+    bool    isEmpty() const         { return rows() <= 0 || m_iColumns == 0; }
+    bool    isGrowable() const      { return m_bGrowable; }
+    int     heightFormat() const    { return m_iHeightFormat; }
+    bool    hasValidity() const     { return m_bValidity; }
+    quint64 bytes() const;
+    /** @brief  line roi (image coordinates) the samples were taken with; kept by clear() **/
+    void    setLineRoi(const QRect &roi)    { m_lineRoi = roi; }
+    QRect   lineRoi() const         { return m_lineRoi; }
+
+    /** @brief  true if row may hold samples **/
+    bool    containsRow(int row) const {
+        return m_bGrowable || (row >= 0 && row < m_iRows);
+    }
+
+    //tile level access for export and display
+    void            tileIndices(std::vector<int> &indices) const;
+    void            tilesChangedSince(quint64 generation, std::vector<int> &indices) const;
+    int             tileCount() const;
+    const ScanTile* tile(int tileIndex) const;
+    /** @brief  first row of a tile **/
+    static int      tileFirstRow(int tileIndex)    { return tileIndex * SCANGRID_TILE_ROWS; }
+
+    /** @brief  tile holding row, NULL if not allocated **/
+    const ScanTile* tileOfRow(int row) const {
+        int t = (row >> SCANGRID_TILE_SHIFT) - m_iFirstTile;
+        return (t >= 0 && t < int(m_tiles.size())) ? m_tiles[t] : NULL;
+    }
+    /** @brief  height at (row, col) **/
+    float   height(int row, int col) const {
+        const ScanTile *t = tileOfRow(row);
+        if (!t)
+            return 0.0f;
+        int i = (row & (SCANGRID_TILE_ROWS - 1)) * m_iColumns + col;
+        return (m_iHeightFormat == SCANGRID_HEIGHT_FLOAT) ? t->heightF[i] : t->heightQ[i] * (1.0f / SCANGRID_FIXED_ONE);
+    }
+    /** @brief  power at (row, col); 0 if nothing was stored **/
+    float   power(int row, int col) const {
+        const ScanTile *t = tileOfRow(row);
+        if (!t)
+            return 0.0f;
+        return t->power[(row & (SCANGRID_TILE_ROWS - 1)) * m_iColumns + col] * (1.0f / SCANGRID_FIXED_ONE);
+    }
+    /** @brief  true if a sample was stored at (row, col); without validity bitmap: power is nonzero **/
+    bool    isValid(int row, int col) const {
+        const ScanTile *t = tileOfRow(row);
+        if (!t)
+            return false;
+        if (!m_bValidity)
+            return t->power[(row & (SCANGRID_TILE_ROWS - 1)) * m_iColumns + col] != 0;
+        return (t->valid[col] >> (row & (SCANGRID_TILE_ROWS - 1))) & 1;
+    }
+    void    set(int row, int col, float height, float power);
+
+private:
+    ScanGrid(const ScanGrid &);             //no copies: tiles are owned; see copyChangedFrom
+    ScanGrid& operator=(const ScanGrid &);
+    ScanTile*       newTile();
+    static quint16  toFixed(float value);
+
+private:
+    int                     m_iRows;            ///< number of rows of a bounded grid
+    int                     m_iColumns;         ///< number of line roi rows
+    int                     m_iHeightFormat;    ///< SCANGRID_HEIGHT_*
+    bool                    m_bValidity;        ///< keep validity bitmaps
+    bool                    m_bGrowable;        ///< rows unbounded
+    QRect                   m_lineRoi;          ///< line roi the samples refer to
+    int                     m_iFirstTile;       ///< tile index of m_tiles[0]
+    std::vector<ScanTile*>  m_tiles;            ///< consecutive tiles from m_iFirstTile on; NULL if not allocated
+    quint64                 m_iGeneration;      ///< change counter, never reset
+    quint64                 m_iResetEpoch;      ///< clear counter, never reset
+};
+
+#endif // SCANGRID_H
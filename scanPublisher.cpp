@@ -0,0 +1,30 @@
+#include "scanPublisher.h"
+
+ScanPublisher::ScanPublisher()
+{
+    m_iBack = 0;
+    m_iReady.storeRelease(1);
+    m_iFront = 2;
+}
+
+/**
+  @brief    producer: publish the current state of grid
+  @param    grid    scan data; not changed during the call (same thread)
+  **/
+void ScanPublisher::publish(const ScanGrid &grid)
+{
+    m_buffers[m_iBack].copyChangedFrom(grid);
+    m_iBack = m_iReady.fetchAndStoreOrdered(m_iBack | SCANPUBLISHER_NEW) & ~SCANPUBLISHER_NEW;
+}
+
+/**
+  @brief    consumer: get the latest published state
+  @return   copy owned by the publisher, unchanged until the next acquire
+  **/
+const ScanGrid* ScanPublisher::acquire()
+{
+    if (m_iReady.loadAcquire() & SCANPUBLISHER_NEW) {
+        m_iFront = m_iReady.fetchAndStoreOrdered(m_iFront) & ~SCANPUBLISHER_NEW;
+    }
+    return &m_buffers[m_iFront];
+}
@@ -0,0 +1,36 @@
+#ifndef SCANPUBLISHER_H
+#define SCANPUBLISHER_H
+
+#include <QAtomicInt>
+#include "scanGrid.h"
+
+#define SCANPUBLISHER_BUFFERS   3           ///< back, ready and front copy
+#define SCANPUBLISHER_NEW       0x100       ///< flag in the ready index: not yet picked up by the consumer
+
+
+/**
+  @class    ScanPublisher   hands consistent copies of a ScanGrid from the processing thread to one reader thread
+
+  Triple buffer: the producer refreshes its back copy and swaps it with the ready one, the consumer swaps
+  the ready copy with its front copy. Both swaps are a single atomic exchange, so neither side ever waits
+  and the consumer's copy can't change while it's being read. Copies are refreshed tile by tile,
+  only tiles changed since that copy was last refreshed are copied.
+
+  Exactly one producer and one consumer thread.
+  **/
+class ScanPublisher
+{
+public:
+    ScanPublisher();
+
+    void            publish(const ScanGrid &grid);
+    const ScanGrid* acquire();
+
+private:
+    ScanGrid        m_buffers[SCANPUBLISHER_BUFFERS];   ///< the copies
+    QAtomicInt      m_iReady;                           ///< index of the ready copy, SCANPUBLISHER_NEW if unread
+    int             m_iBack;                            ///< producer's copy
+    int             m_iFront;                           ///< consumer's copy
+};
+
+#endif // SCANPUBLISHER_H
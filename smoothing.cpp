@@ -0,0 +1,445 @@
+#include "smoothing.h"
+#include "QtException.h"
+#include <QElapsedTimer>
+#include <math.h>
+#include <string.h>
+
+/**
+  @brief    radii of SMOOTH_BOX_PASSES boxes whose cascade has (about) the variance of a gaussian
+  @param    sigma   standard deviation of the gaussian
+  @param    radii   output: SMOOTH_BOX_PASSES radii
+
+  Widths are the two odd numbers around the ideal width, mixed to match the variance
+  **/
+static void boxRadii(double sigma, int *radii)
+{
+    const int n = SMOOTH_BOX_PASSES;
+    double wIdeal = sqrt(12.0 * sigma * sigma / n + 1.0);
+    int wl = int(floor(wIdeal));
+    if (wl % 2 == 0)
+        wl--;
+    if (wl < 1)
+        wl = 1;
+    int wu = wl + 2;
+    double mIdeal = (12.0 * sigma * sigma - n * wl * wl - 4.0 * n * wl - 3.0 * n) / (-4.0 * wl - 4.0);
+    int m = int(floor(mIdeal + 0.5));
+    if (m < 0)
+        m = 0;
+    if (m > n)
+        m = n;
+    for (int i = 0; i < n; i++) {
+        radii[i] = ((i < m) ? wl : wu) / 2;
+    }
+}
+
+/**
+  @brief    box filter along a contiguous line, replicated border
+  @param    src     input, n values
+  @param    dst     output, n values; must not alias src
+  @param    r       radius; box width is 2r+1
+  **/
+static void boxLine(const float *src, float *dst, int n, int r)
+{
+    if (r <= 0) {
+        memcpy(dst, src, n * sizeof(float));
+        return;
+    }
+    double inv = 1.0 / (2 * r + 1);
+    double sum = double(src[0]) * (r + 1);
+    for (int k = 1; k <= r; k++) {
+        sum += src[(k < n) ? k : n - 1];
+    }
+    for (int i = 0; i < n; i++) {
+        dst[i] = float(sum * inv);
+        int add = i + r + 1;
+        int sub = i - r;
+        sum += double(src[(add < n) ? add : n - 1]) - double(src[(sub > 0) ? sub : 0]);
+    }
+}
+
+/**
+  @brief    box filter along columns, replicated border; whole rows at a time
+  @param    acc     scratch, width values
+  **/
+static void boxColumns(const float *src, int srcStep, float *dst, int dstStep, int width, int height, int r, double *acc)
+{
+    if (r <= 0) {
+        for (int y = 0; y < height; y++) {
+            memcpy(dst + y * dstStep, src + y * srcStep, width * sizeof(float));
+        }
+        return;
+    }
+    double inv = 1.0 / (2 * r + 1);
+    for (int x = 0; x < width; x++) {
+        acc[x] = double(src[x]) * (r + 1);
+    }
+    for (int k = 1; k <= r; k++) {
+        const float *row = src + ((k < height) ? k : height - 1) * srcStep;
+        for (int x = 0; x < width; x++) {
+            acc[x] += row[x];
+        }
+    }
+    for (int y = 0; y < height; y++) {
+        float *d = dst + y * dstStep;
+        int add = y + r + 1;
+        int sub = y - r;
+        const float *rowAdd = src + ((add < height) ? add : height - 1) * srcStep;
+        const float *rowSub = src + ((sub > 0) ? sub : 0) * srcStep;
+        for (int x = 0; x < width; x++) {
+            d[x] = float(acc[x] * inv);
+            acc[x] += double(rowAdd[x]) - double(rowSub[x]);
+        }
+    }
+}
+
+/**
+  @brief    fixed point box filter along a contiguous line, replicated border
+  **/
+static void boxLineFixed(const int *src, int *dst, int n, int r)
+{
+    if (r <= 0) {
+        memcpy(dst, src, n * sizeof(int));
+        return;
+    }
+    const qint64 mul = ((qint64(1) << 24) + r) / (2 * r + 1);  //rounded 1/(2r+1) in 8.24
+    int sum = src[0] * (r + 1);
+    for (int k = 1; k <= r; k++) {
+        sum += src[(k < n) ? k : n - 1];
+    }
+    for (int i = 0; i < n; i++) {
+        dst[i] = int((qint64(sum) * mul + (1 << 23)) >> 24);
+        int add = i + r + 1;
+        int sub = i - r;
+        sum += src[(add < n) ? add : n - 1] - src[(sub > 0) ? sub : 0];
+    }
+}
+
+/**
+  @brief    fixed point box filter along columns, replicated border
+  **/
+static void boxColumnsFixed(const int *src, int *dst, int width, int height, int r, int *acc)
+{
+    if (r <= 0) {
+        memcpy(dst, src, width * height * sizeof(int));
+        return;
+    }
+    const qint64 mul = ((qint64(1) << 24) + r) / (2 * r + 1);
+    for (int x = 0; x < width; x++) {
+        acc[x] = src[x] * (r + 1);
+    }
+    for (int k = 1; k <= r; k++) {
+        const int *row = src + ((k < height) ? k : height - 1) * width;
+        for (int x = 0; x < width; x++) {
+            acc[x] += row[x];
+        }
+    }
+    for (int y = 0; y < height; y++) {
+        int *d = dst + y * width;
+        int add = y + r + 1;
+        int sub = y - r;
+        const int *rowAdd = src + ((add < height) ? add : height - 1) * width;
+        const int *rowSub = src + ((sub > 0) ? sub : 0) * width;
+        for (int x = 0; x < width; x++) {
+            d[x] = int((qint64(acc[x]) * mul + (1 << 23)) >> 24);
+            acc[x] += rowAdd[x] - rowSub[x];
+        }
+    }
+}
+
+/**
+  @brief    Young - van Vliet coefficients of the recursive gaussian
+  @param    sigma   standard deviation; values below 0.5 are treated as 0.5
+  @param    B       output: input gain
+  @param    c       output: three feedback coefficients, normalized by b0
+  **/
+static void recursiveCoefficients(double sigma, double &B, double *c)
+{
+    if (sigma < 0.5)
+        sigma = 0.5;
+    double q = (sigma >= 2.5) ? (0.98711 * sigma - 0.96330) : (3.97156 - 4.14554 * sqrt(1.0 - 0.26891 * sigma));
+    double q2 = q * q;
+    double q3 = q2 * q;
+    double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+    c[0] = (2.44413 * q + 2.85619 * q2 + 1.26661 * q3) / b0;
+    c[1] = -(1.4281 * q2 + 1.26661 * q3) / b0;
+    c[2] = 0.422205 * q3 / b0;
+    B = 1.0 - (c[0] + c[1] + c[2]);
+}
+
+GaussianSmoother::GaussianSmoother()
+{
+    m_iBackend = SMOOTH_OPENCV;
+}
+
+/**
+  @brief    select backend used by smooth(img, kx, ky)
+  @param    backend one of SMOOTH_*
+  **/
+void GaussianSmoother::setBackend(int backend)
+{
+    if (backend < 0 || backend >= SMOOTH_BACKEND_COUNT) {
+        DEBUG(1, QString("Invalid smoothing backend %1").arg(backend));
+        return;
+    }
+    m_iBackend = backend;
+}
+
+/**
+  @brief    get selected backend
+  **/
+int GaussianSmoother::backend()
+{
+    return m_iBackend;
+}
+
+/**
+  @brief    sigma opencv uses for a kernel size if no sigma is given
+  **/
+double GaussianSmoother::sigmaForKernelSize(int ksize)
+{
+    return 0.3 * ((ksize - 1) * 0.5 - 1.0) + 0.8;
+}
+
+/**
+  @brief    human readable name of a backend
+  **/
+QString GaussianSmoother::backendName(int backend)
+{
+    switch (backend) {
+    case SMOOTH_OPENCV:     return "opencv";
+    case SMOOTH_RECURSIVE:  return "recursive";
+    case SMOOTH_BOX:        return "box";
+    case SMOOTH_FIXEDPOINT: return "fixedpoint";
+    default:                return "invalid";
+    }
+}
+
+/**
+  @brief    smooth in place with the selected backend
+  @param    img     IPL_DEPTH_32F single channel image; its roi is ignored
+  @param    kx      kernel width as for cvSmooth; defines sigma
+  @param    ky      kernel height as for cvSmooth; defines sigma
+  **/
+void GaussianSmoother::smooth(IplImage *img, int kx, int ky)
+{
+    smooth(img, kx, ky, m_iBackend);
+}
+
+/**
+  @brief    smooth in place with a given backend
+  **/
+void GaussianSmoother::smooth(IplImage *img, int kx, int ky, int backend)
+{
+    if (img->depth != IPL_DEPTH_32F || img->nChannels != 1) {
+        EX_THROW("GaussianSmoother: invalid image format");
+    }
+    if (img->width < 1 || img->height < 1)
+        return;
+
+    float *data = (float*) img->imageData;
+    int step = img->widthStep / sizeof(float);
+    double sigmaX = sigmaForKernelSize(kx);
+    double sigmaY = sigmaForKernelSize(ky);
+
+    switch (backend) {
+    case SMOOTH_RECURSIVE:
+        smoothRecursive(data, img->width, img->height, step, sigmaX, sigmaY);
+        break;
+    case SMOOTH_BOX:
+        smoothBox(data, img->width, img->height, step, sigmaX, sigmaY);
+        break;
+    case SMOOTH_FIXEDPOINT:
+        smoothFixedPoint(data, img->width, img->height, step, sigmaX, sigmaY);
+        break;
+    default:
+        cvSmooth(img, img, CV_GAUSSIAN, kx, ky);
+        break;
+    }
+}
+
+/**
+  @brief    recursive gaussian, in place: forward and backward third order IIR along rows and columns
+
+  The filter state starts at the border value; a constant signal is its own steady state, so the
+  first output equals the first input and out of image rows can be taken from the border row.
+  **/
+void GaussianSmoother::smoothRecursive(float *data, int width, int height, int step, double sigmaX, double sigmaY)
+{
+    double B, c[3];
+
+    //rows
+    recursiveCoefficients(sigmaX, B, c);
+    for (int y = 0; y < height; y++) {
+        float *row = data + y * step;
+        double w1 = row[0], w2 = row[0], w3 = row[0], w;
+        for (int x = 0; x < width; x++) {
+            w = B * row[x] + c[0] * w1 + c[1] * w2 + c[2] * w3;
+            row[x] = float(w);
+            w3 = w2; w2 = w1; w1 = w;
+        }
+        w1 = w2 = w3 = row[width - 1];
+        for (int x = width - 1; x >= 0; x--) {
+            w = B * row[x] + c[0] * w1 + c[1] * w2 + c[2] * w3;
+            row[x] = float(w);
+            w3 = w2; w2 = w1; w1 = w;
+        }
+    }
+
+    //columns, whole rows at a time
+    recursiveCoefficients(sigmaY, B, c);
+    const float fB = float(B), c0 = float(c[0]), c1 = float(c[1]), c2 = float(c[2]);
+    for (int y = 1; y < height; y++) {
+        float *row = data + y * step;
+        const float *p1 = data + (y - 1) * step;
+        const float *p2 = data + ((y > 1) ? y - 2 : 0) * step;
+        const float *p3 = data + ((y > 2) ? y - 3 : 0) * step;
+        for (int x = 0; x < width; x++) {
+            row[x] = fB * row[x] + c0 * p1[x] + c1 * p2[x] + c2 * p3[x];
+        }
+    }
+    for (int y = height - 2; y >= 0; y--) {
+        float *row = data + y * step;
+        const float *p1 = data + (y + 1) * step;
+        const float *p2 = data + ((y + 2 < height) ? y + 2 : height - 1) * step;
+        const float *p3 = data + ((y + 3 < height) ? y + 3 : height - 1) * step;
+        for (int x = 0; x < width; x++) {
+            row[x] = fB * row[x] + c0 * p1[x] + c1 * p2[x] + c2 * p3[x];
+        }
+    }
+}
+
+/**
+  @brief    cascade of box filters with float running sums
+  **/
+void GaussianSmoother::smoothBox(float *data, int width, int height, int step, double sigmaX, double sigmaY)
+{
+    int rx[SMOOTH_BOX_PASSES], ry[SMOOTH_BOX_PASSES];
+    boxRadii(sigmaX, rx);
+    boxRadii(sigmaY, ry);
+
+    if (int(m_tmp.size()) < width * height)
+        m_tmp.resize(width * height);
+    if (int(m_sums.size()) < width)
+        m_sums.resize(width);
+    if (int(m_rows.size()) < 2 * width)
+        m_rows.resize(2 * width);
+    float *tmp = &m_tmp[0];
+    float *a = &m_rows[0];
+    float *b = a + width;
+
+    //columns: data -> tmp -> data -> tmp
+    boxColumns(data, step, tmp, width, width, height, ry[0], &m_sums[0]);
+    boxColumns(tmp, width, data, step, width, height, ry[1], &m_sums[0]);
+    boxColumns(data, step, tmp, width, width, height, ry[2], &m_sums[0]);
+
+    //rows: tmp -> a -> b -> data
+    for (int y = 0; y < height; y++) {
+        boxLine(tmp + y * width, a, width, rx[0]);
+        boxLine(a, b, width, rx[1]);
+        boxLine(b, data + y * step, width, rx[2]);
+    }
+}
+
+/**
+  @brief    cascade of box filters with integer running sums on fixed point data
+  **/
+void GaussianSmoother::smoothFixedPoint(float *data, int width, int height, int step, double sigmaX, double sigmaY)
+{
+    int rx[SMOOTH_BOX_PASSES], ry[SMOOTH_BOX_PASSES];
+    boxRadii(sigmaX, rx);
+    boxRadii(sigmaY, ry);
+
+    for (int i = 0; i < 2; i++) {
+        if (int(m_fixed[i].size()) < width * height)
+            m_fixed[i].resize(width * height);
+    }
+    if (int(m_fixedSums.size()) < 3 * width)
+        m_fixedSums.resize(3 * width);
+    int *f0 = &m_fixed[0][0];
+    int *f1 = &m_fixed[1][0];
+    int *acc = &m_fixedSums[0];
+    int *a = acc + width;
+    int *b = a + width;
+
+    const float scale = float(1 << SMOOTH_FIXEDPOINT_SHIFT);
+    for (int y = 0; y < height; y++) {
+        const float *row = data + y * step;
+        int *f = f0 + y * width;
+        for (int x = 0; x < width; x++) {
+            f[x] = int(row[x] * scale + 0.5f);
+        }
+    }
+
+    //columns: f0 -> f1 -> f0 -> f1
+    boxColumnsFixed(f0, f1, width, height, ry[0], acc);
+    boxColumnsFixed(f1, f0, width, height, ry[1], acc);
+    boxColumnsFixed(f0, f1, width, height, ry[2], acc);
+
+    //rows: f1 -> a -> b -> f0 -> data
+    const float invScale = 1.0f / scale;
+    for (int y = 0; y < height; y++) {
+        int *f = f0 + y * width;
+        boxLineFixed(f1 + y * width, a, width, rx[0]);
+        boxLineFixed(a, b, width, rx[1]);
+        boxLineFixed(b, f, width, rx[2]);
+        float *row = data + y * step;
+        for (int x = 0; x < width; x++) {
+            row[x] = float(f[x]) * invScale;
+        }
+    }
+}
+
+/**
+  @brief    compare all backends against cvSmooth on a sample image
+  @param    img     IPL_DEPTH_32F single channel sample, e.g. a roi copy before smoothing; left unchanged
+  @param    kx      kernel width as for cvSmooth
+  @param    ky      kernel height as for cvSmooth
+  @return   one line per backend: runtime, max and rms deviation, shift of the maximum
+  **/
+QString GaussianSmoother::accuracyReport(const IplImage *img, int kx, int ky)
+{
+    IplImage *ref = cvCloneImage(img);
+    IplImage *test = cvCloneImage(img);
+    QElapsedTimer timer;
+    QString report = QString("Smoothing %1x%2 (%3x%4 pixels):\n").arg(kx).arg(ky).arg(img->width).arg(img->height);
+
+    timer.start();
+    smooth(ref, kx, ky, SMOOTH_OPENCV);
+    qint64 refNs = timer.nsecsElapsed();
+    CvPoint refMax;
+    double refMaxVal;
+    cvMinMaxLoc(ref, NULL, &refMaxVal, NULL, &refMax);
+
+    for (int backend = 0; backend < SMOOTH_BACKEND_COUNT; backend++) {
+        cvCopy(img, test);
+        timer.restart();
+        smooth(test, kx, ky, backend);
+        qint64 ns = (backend == SMOOTH_OPENCV) ? refNs : timer.nsecsElapsed();
+
+        double maxErr = 0;
+        double sqErr = 0;
+        for (int y = 0; y < img->height; y++) {
+            const float *r = (const float*) (ref->imageData + y * ref->widthStep);
+            const float *t = (const float*) (test->imageData + y * test->widthStep);
+            for (int x = 0; x < img->width; x++) {
+                double e = fabs(double(t[x]) - double(r[x]));
+                if (e > maxErr)
+                    maxErr = e;
+                sqErr += e * e;
+            }
+        }
+        CvPoint testMax;
+        cvMinMaxLoc(test, NULL, NULL, NULL, &testMax);
+
+        report += QString("  %1: %2 ms, max err %3, rms err %4 (peak %5), maximum shifted by (%6, %7)\n")
+                .arg(backendName(backend), -10)
+                .arg(ns / 1.0e6, 0, 'f', 3)
+                .arg(maxErr, 0, 'g', 4)
+                .arg(sqrt(sqErr / (double(img->width) * img->height)), 0, 'g', 4)
+                .arg(refMaxVal, 0, 'g', 4)
+                .arg(testMax.x - refMax.x).arg(testMax.y - refMax.y);
+    }
+    cvReleaseImage(&ref);
+    cvReleaseImage(&test);
+    return report;
+}
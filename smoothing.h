@@ -0,0 +1,63 @@
+/**
+  @file     smoothing.h
+  @brief    gaussian smoothing of float roi images with selectable backends
+
+  Besides the cvSmooth reference all backends cost the same per pixel regardless of kernel size:
+  the recursive filter runs a third order IIR forward and backward, the box cascades approximate
+  the gaussian by three box filters done with running sums. Borders are replicated.
+  **/
+
+#ifndef SMOOTHING_H
+#define SMOOTHING_H
+
+#include <vector>
+#include <QString>
+#include <opencv.hpp>
+
+//smoothing backends
+#define SMOOTH_OPENCV           0       ///< cvSmooth CV_GAUSSIAN, reference
+#define SMOOTH_RECURSIVE        1       ///< Young - van Vliet recursive gaussian, float
+#define SMOOTH_BOX              2       ///< cascade of three box filters, float running sums
+#define SMOOTH_FIXEDPOINT       3       ///< cascade of three box filters, integer running sums on 24.8 fixed point data
+#define SMOOTH_BACKEND_COUNT    4
+
+#define SMOOTH_BOX_PASSES       3       ///< number of boxes in the cascades
+#define SMOOTH_FIXEDPOINT_SHIFT 8       ///< fractional bits of fixed point data
+
+/**
+  @class    GaussianSmoother    in place gaussian smoothing of IPL_DEPTH_32F single channel images
+
+  Scratch memory is kept between calls, so smoothing same sized rois every frame doesn't allocate.
+  Not thread safe; one instance per processing thread.
+  **/
+class GaussianSmoother
+{
+public:
+    GaussianSmoother();
+
+    void    setBackend(int backend);
+    int     backend();
+
+    void    smooth(IplImage *img, int kx, int ky);
+    void    smooth(IplImage *img, int kx, int ky, int backend);
+
+    QString accuracyReport(const IplImage *img, int kx, int ky);
+
+    static double   sigmaForKernelSize(int ksize);
+    static QString  backendName(int backend);
+
+private:
+    void    smoothRecursive(float *data, int width, int height, int step, double sigmaX, double sigmaY);
+    void    smoothBox(float *data, int width, int height, int step, double sigmaX, double sigmaY);
+    void    smoothFixedPoint(float *data, int width, int height, int step, double sigmaX, double sigmaY);
+
+private:
+    int                 m_iBackend;     ///< selected backend, SMOOTH_*
+    std::vector<double> m_sums;         ///< scratch: column sums
+    std::vector<float>  m_rows;         ///< scratch: two row buffers
+    std::vector<float>  m_tmp;          ///< scratch: image sized float buffer
+    std::vector<int>    m_fixed[2];     ///< scratch: image sized fixed point ping pong buffers
+    std::vector<int>    m_fixedSums;    ///< scratch: fixed point column sums / two row buffers
+};
+
+#endif // SMOOTHING_H
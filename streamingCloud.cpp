@@ -0,0 +1,108 @@
+#include "streamingCloud.h"
+
+/************************************** StreamingCloudView **************************************/
+
+StreamingCloudView::StreamingCloudView()
+{
+    m_iFirstChunk = 0;
+    m_iFirst = 0;
+    m_iEnd = 0;
+}
+
+/**
+  @brief    number of points stored contiguously from point i on, at most up to end()
+  **/
+size_t StreamingCloudView::run(size_t i) const
+{
+    size_t chunkEnd = ((i >> STREAMCLOUD_CHUNK_SHIFT) + 1) << STREAMCLOUD_CHUNK_SHIFT;
+    return qMin(chunkEnd, m_iEnd) - i;
+}
+
+/**
+  @brief    append all points of the view to a cloud
+  **/
+void StreamingCloudView::copyTo(PointCloud *cloud) const
+{
+    cloud->reserve(cloud->size() + size());
+    for (size_t i = m_iFirst; i < m_iEnd; i++) {
+        cloud->append(point(i));
+    }
+}
+
+/************************************** StreamingCloud **************************************/
+
+StreamingCloud::StreamingCloud()
+{
+    m_iCommitted = 0;
+    m_iGeneration = 0;
+    m_iSize = 0;
+    m_pWrite = NULL;
+}
+
+/**
+  @brief    writer: start a new chunk
+  **/
+void StreamingCloud::addChunk()
+{
+    StreamChunk chunk(new std::vector<float>(3 * STREAMCLOUD_CHUNK_POINTS));
+    m_pWrite = &(*chunk)[0];
+    QMutexLocker lock(&m_mutex);
+    m_chunks.push_back(chunk);
+}
+
+/**
+  @brief    writer: make all appended points visible
+  **/
+void StreamingCloud::commit()
+{
+    QMutexLocker lock(&m_mutex);
+    m_iCommitted = m_iSize;
+}
+
+/**
+  @brief    writer: drop all points; views taken before keep theirs
+  **/
+void StreamingCloud::clear()
+{
+    QMutexLocker lock(&m_mutex);
+    m_chunks.clear();
+    m_iCommitted = 0;
+    m_iSize = 0;
+    m_pWrite = NULL;
+    ++m_iGeneration;
+}
+
+/**
+  @brief    number of committed points
+  **/
+size_t StreamingCloud::size()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_iCommitted;
+}
+
+/**
+  @brief    changes whenever the cloud is cleared; a reader holding an older generation has to start over at 0
+  **/
+quint64 StreamingCloud::generation()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_iGeneration;
+}
+
+/**
+  @brief    snapshot of the committed points from first on
+  @param    first   first point of interest, e.g. the end() of a previous view to get only new points
+  **/
+StreamingCloudView StreamingCloud::view(size_t first /*= 0*/)
+{
+    StreamingCloudView v;
+    QMutexLocker lock(&m_mutex);
+    v.m_iEnd = m_iCommitted;
+    v.m_iFirst = qMin(first, m_iCommitted);
+    v.m_iFirstChunk = v.m_iFirst >> STREAMCLOUD_CHUNK_SHIFT;
+    size_t endChunk = (v.m_iEnd + STREAMCLOUD_CHUNK_POINTS - 1) >> STREAMCLOUD_CHUNK_SHIFT;
+    if (endChunk > v.m_iFirstChunk)
+        v.m_chunks.assign(m_chunks.begin() + v.m_iFirstChunk, m_chunks.begin() + endChunk);
+    return v;
+}
@@ -0,0 +1,87 @@
+#ifndef STREAMINGCLOUD_H
+#define STREAMINGCLOUD_H
+
+#include <vector>
+#include <QMutex>
+#include <QSharedPointer>
+#include "pointCloud.h"
+
+#define STREAMCLOUD_CHUNK_SHIFT     16      ///< log2 of points per chunk
+#define STREAMCLOUD_CHUNK_POINTS    (1 << STREAMCLOUD_CHUNK_SHIFT)
+
+typedef QSharedPointer< std::vector<float> > StreamChunk;   ///< STREAMCLOUD_CHUNK_POINTS x, y, z; never reallocated
+
+
+/**
+  @class    StreamingCloudView  read only snapshot of a range of a StreamingCloud
+
+  Holds references to the chunks it covers, so it stays valid even if the cloud is cleared meanwhile.
+  **/
+class StreamingCloudView
+{
+public:
+    StreamingCloudView();
+
+    size_t          first() const           { return m_iFirst; }
+    size_t          end() const             { return m_iEnd; }
+    size_t          size() const            { return m_iEnd - m_iFirst; }
+    bool            isEmpty() const         { return m_iEnd <= m_iFirst; }
+
+    /** @brief  coordinates of point i, first() <= i < end() **/
+    const float*    point(size_t i) const   { return &(*m_chunks[(i >> STREAMCLOUD_CHUNK_SHIFT) - m_iFirstChunk])[3 * (i & (STREAMCLOUD_CHUNK_POINTS - 1))]; }
+    size_t          run(size_t i) const;
+    void            copyTo(PointCloud *cloud) const;
+
+private:
+    friend class StreamingCloud;
+    std::vector<StreamChunk>    m_chunks;       ///< chunks from m_iFirstChunk on
+    size_t                      m_iFirstChunk;  ///< chunk index of m_chunks[0]
+    size_t                      m_iFirst;       ///< first point
+    size_t                      m_iEnd;         ///< one past the last point
+};
+
+
+/**
+  @class    StreamingCloud  append only point buffer in fixed size chunks, filled while digitizing
+
+  One writer appends the points of a profile and publishes them with commit(); any number of readers
+  take views of the committed points at any time. Chunks are never moved, so appending costs no copies
+  and readers of old points don't wait for the writer. The mutex only guards the chunk list.
+  **/
+class StreamingCloud
+{
+public:
+    StreamingCloud();
+
+    /** @brief  writer: add a point, visible to readers after commit() **/
+    inline void     append(const float *xyz)
+    {
+        size_t offset = m_iSize & (STREAMCLOUD_CHUNK_POINTS - 1);
+        if (offset == 0)
+            addChunk();
+        float *p = m_pWrite + 3 * offset;
+        p[0] = xyz[0];
+        p[1] = xyz[1];
+        p[2] = xyz[2];
+        ++m_iSize;
+    }
+    void                commit();
+    void                clear();
+
+    size_t              size();
+    quint64             generation();
+    StreamingCloudView  view(size_t first = 0);
+
+private:
+    void                addChunk();
+
+private:
+    QMutex                      m_mutex;        ///< guards m_chunks, m_iCommitted, m_iGeneration
+    std::vector<StreamChunk>    m_chunks;       ///< all chunks
+    size_t                      m_iCommitted;   ///< points visible to readers
+    quint64                     m_iGeneration;  ///< bumped by clear(), tells readers to start over
+    size_t                      m_iSize;        ///< writer: points appended
+    float*                      m_pWrite;       ///< writer: current chunk
+};
+
+#endif // STREAMINGCLOUD_H
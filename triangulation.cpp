@@ -0,0 +1,257 @@
+#include "triangulation.h"
+#include "QtException.h"
+#include <limits>
+#include <math.h>
+
+LaserTriangulator::LaserTriangulator()
+{
+    m_plane = cv::Vec4d(0., 0., 0., 0.);
+    m_sliderStep = cv::Vec3d(0., 0., 0.);
+    m_cameraToWorld = cv::Mat::eye(4, 4, CV_64F);
+    m_bIntrinsics = false;
+    m_bExtrinsics = false;
+    m_bDirty = true;
+    m_iLutWidth = 0;
+    m_dColumnScale = 0.;
+    m_step[0] = m_step[1] = m_step[2] = 0.f;
+}
+
+/**
+  @brief    open a calibration file for reading
+  @return   false if missing or unparsable
+  **/
+bool LaserTriangulator::openStorage(cv::FileStorage *fs, const QString &fileName)
+{
+    try {
+        return fs->open(fileName.toLocal8Bit().constData(), cv::FileStorage::READ);
+    } catch (cv::Exception &e) {
+        DEBUG(1, QString("Could not parse %1: %2").arg(fileName).arg(e.what()));
+        return false;
+    }
+}
+
+/**
+  @brief    load camera intrinsics as written by the opencv calibration sample
+  @param    fileName    FileStorage (xml/yml) with camera_matrix and distortion_coefficients, or a single matrix A
+  @return   false if the file can't be read; the previous intrinsics are kept
+  **/
+bool LaserTriangulator::loadIntrinsics(const QString &fileName)
+{
+    cv::FileStorage fs;
+    if (!openStorage(&fs, fileName)) {
+        DEBUG(10, QString("No intrinsic calibration in %1").arg(fileName));
+        return false;
+    }
+    cv::Mat cameraMatrix, distortion;
+    fs["camera_matrix"] >> cameraMatrix;
+    fs["distortion_coefficients"] >> distortion;
+    if (cameraMatrix.empty())
+        fs["A"] >> cameraMatrix;    //plain matrix as written by cvSave
+
+    if (cameraMatrix.rows != 3 || cameraMatrix.cols != 3) {
+        DEBUG(1, QString("Invalid camera_matrix in %1").arg(fileName));
+        return false;
+    }
+    setIntrinsics(cameraMatrix, distortion);
+    return true;
+}
+
+/**
+  @brief    load laser plane and slider geometry
+  @param    fileName    FileStorage with laser_plane (4 values), slider_step (3 values), optional camera_to_world (4x4, or a single matrix A)
+  @return   false if the file can't be read or lacks the laser geometry
+  **/
+bool LaserTriangulator::loadExtrinsics(const QString &fileName)
+{
+    cv::FileStorage fs;
+    if (!openStorage(&fs, fileName)) {
+        DEBUG(10, QString("No external calibration in %1").arg(fileName));
+        return false;
+    }
+    cv::Mat plane, step, transform;
+    fs["laser_plane"] >> plane;
+    fs["slider_step"] >> step;
+    fs["camera_to_world"] >> transform;
+    if (transform.empty())
+        fs["A"] >> transform;       //plain matrix as written by cvSave
+    if (!transform.empty())
+        setCameraToWorld(transform);
+    if (plane.total() != 4 || step.total() != 3) {
+        DEBUG(1, QString("No laser_plane or slider_step in %1").arg(fileName));
+        return false;
+    }
+    plane.convertTo(plane, CV_64F);
+    step.convertTo(step, CV_64F);
+    setLaserPlane(cv::Vec4d(plane.ptr<double>()));
+    setSliderStep(cv::Vec3d(step.ptr<double>()));
+    return true;
+}
+
+/**
+  @brief    save camera intrinsics in the format loadIntrinsics() reads
+  **/
+bool LaserTriangulator::saveIntrinsics(const QString &fileName)
+{
+    if (!m_bIntrinsics)
+        return false;
+    cv::FileStorage fs(fileName.toLocal8Bit().constData(), cv::FileStorage::WRITE);
+    if (!fs.isOpened()) {
+        DEBUG(1, QString("Could not open %1 for writing").arg(fileName));
+        return false;
+    }
+    fs << "camera_matrix" << m_cameraMatrix;
+    fs << "distortion_coefficients" << m_distortion;
+    return true;
+}
+
+/**
+  @brief    save laser plane and slider geometry in the format loadExtrinsics() reads
+  **/
+bool LaserTriangulator::saveExtrinsics(const QString &fileName)
+{
+    if (!m_bExtrinsics)
+        return false;
+    cv::FileStorage fs(fileName.toLocal8Bit().constData(), cv::FileStorage::WRITE);
+    if (!fs.isOpened()) {
+        DEBUG(1, QString("Could not open %1 for writing").arg(fileName));
+        return false;
+    }
+    fs << "laser_plane" << cv::Mat(m_plane);
+    fs << "slider_step" << cv::Mat(m_sliderStep);
+    fs << "camera_to_world" << m_cameraToWorld;
+    return true;
+}
+
+/**
+  @brief    set camera intrinsics
+  @param    cameraMatrix    3x3 camera matrix
+  @param    distortion      distortion coefficients as used by cv::undistortPoints; may be empty
+  **/
+void LaserTriangulator::setIntrinsics(const cv::Mat &cameraMatrix, const cv::Mat &distortion)
+{
+    cv::Mat k, dist;    //fresh matrices: copies of this object may still share the old ones
+    cameraMatrix.convertTo(k, CV_64F);
+    if (distortion.empty())
+        dist = cv::Mat::zeros(1, 5, CV_64F);
+    else
+        distortion.convertTo(dist, CV_64F);
+    m_cameraMatrix = k;
+    m_distortion = dist;
+    m_bIntrinsics = true;
+    m_bDirty = true;
+}
+
+/**
+  @brief    set laser plane (a, b, c, d): a*x + b*y + c*z + d = 0 in camera coordinates
+  **/
+void LaserTriangulator::setLaserPlane(const cv::Vec4d &plane)
+{
+    m_plane = plane;
+    m_bExtrinsics = (cv::norm(m_sliderStep) > 0.) && (cv::norm(cv::Vec3d(m_plane[0], m_plane[1], m_plane[2])) > 0.);
+    m_bDirty = true;
+}
+
+/**
+  @brief    set displacement of the part per slider position, in camera coordinates
+  **/
+void LaserTriangulator::setSliderStep(const cv::Vec3d &step)
+{
+    m_sliderStep = step;
+    m_bExtrinsics = (cv::norm(m_sliderStep) > 0.) && (cv::norm(cv::Vec3d(m_plane[0], m_plane[1], m_plane[2])) > 0.);
+    m_bDirty = true;
+}
+
+/**
+  @brief    set rigid transform applied to all triangulated points
+  @param    transform   4x4 camera to world matrix
+  **/
+void LaserTriangulator::setCameraToWorld(const cv::Mat &transform)
+{
+    if (transform.rows != 4 || transform.cols != 4) {
+        DEBUG(1, "Warning: camera to world transform must be 4x4, using identity");
+        m_cameraToWorld = cv::Mat::eye(4, 4, CV_64F);
+    } else {
+        cv::Mat t;
+        transform.convertTo(t, CV_64F);
+        m_cameraToWorld = t;
+    }
+    m_bDirty = true;
+}
+
+/**
+  @brief    true if intrinsics, laser plane and slider step are known
+  **/
+bool LaserTriangulator::isCalibrated() const
+{
+    return m_bIntrinsics && m_bExtrinsics;
+}
+
+/**
+  @brief    get ready to triangulate samples of a line roi; cheap if nothing changed since the last call
+  @param    roiLine     line roi (image coordinates) the scan was taken with
+  @return   false if not calibrated or the roi is too small
+  **/
+bool LaserTriangulator::prepare(const QRect &roiLine)
+{
+    if (!isCalibrated() || roiLine.width() < 2 || roiLine.height() < 1)
+        return false;
+    if (m_bDirty || roiLine != m_roi) {
+        m_roi = roiLine;
+        buildLut();
+        m_bDirty = false;
+    }
+    return true;
+}
+
+/**
+  @brief    line roi the lookup table was built for
+  **/
+const QRect& LaserTriangulator::roi() const
+{
+    return m_roi;
+}
+
+/**
+  @brief    intersect the ray of every roi pixel with the laser plane
+  **/
+void LaserTriangulator::buildLut()
+{
+    const int w = m_roi.width();
+    const int h = m_roi.height();
+    m_iLutWidth = w;
+    m_dColumnScale = double(w) / TRIANGULATION_HEIGHT_RANGE;        //inverse of the height encoding in evaluateImage
+    m_lut.resize(size_t(w) * h * 3);
+
+    std::vector<cv::Point2f> pixels(size_t(w) * h);
+    for (int y = 0; y < h; y++) {
+        for (int u = 0; u < w; u++) {
+            pixels[size_t(y) * w + u] = cv::Point2f(float(m_roi.x() + u), float(m_roi.y() + y));
+        }
+    }
+    std::vector<cv::Point2f> rays;  //normalized image coordinates: ray direction (x, y, 1)
+    cv::undistortPoints(pixels, rays, m_cameraMatrix, m_distortion);
+
+    const double *T = m_cameraToWorld.ptr<double>();
+    const double nx = m_plane[0], ny = m_plane[1], nz = m_plane[2], d = m_plane[3];
+    const float invalid = std::numeric_limits<float>::quiet_NaN();
+    for (size_t i = 0; i < rays.size(); i++) {
+        float *p = &m_lut[3 * i];
+        double rx = rays[i].x, ry = rays[i].y;
+        double denom = nx * rx + ny * ry + nz;
+        double t = (fabs(denom) > TRIANGULATION_MIN_ANGLE * sqrt(rx * rx + ry * ry + 1.)) ? -d / denom : -1.;
+        if (t <= 0.) {  //parallel or behind the camera
+            p[0] = p[1] = p[2] = invalid;
+            continue;
+        }
+        double x = t * rx, y = t * ry, z = t;
+        p[0] = float(T[0] * x + T[1] * y + T[2]  * z + T[3]);
+        p[1] = float(T[4] * x + T[5] * y + T[6]  * z + T[7]);
+        p[2] = float(T[8] * x + T[9] * y + T[10] * z + T[11]);
+    }
+
+    //the step is a displacement: rotate only
+    for (int k = 0; k < 3; k++) {
+        m_step[k] = float(T[4 * k] * m_sliderStep[0] + T[4 * k + 1] * m_sliderStep[1] + T[4 * k + 2] * m_sliderStep[2]);
+    }
+    DEBUG(10, QString("Triangulation table built for %1x%2 roi pixels").arg(w).arg(h));
+}
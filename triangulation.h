@@ -0,0 +1,111 @@
+#ifndef TRIANGULATION_H
+#define TRIANGULATION_H
+
+#include <vector>
+#include <QString>
+#include <QRect>
+#include <opencv.hpp>
+
+#define TRIANGULATION_HEIGHT_RANGE  255.0   ///< scan heights run from 255 (left roi border) to 0 (right roi border)
+#define TRIANGULATION_MIN_ANGLE     1e-6    ///< rays closer to parallel with the laser plane than this (cosine) are invalid
+
+
+/**
+  @class    LaserTriangulator   calibrated laser plane triangulation of line roi samples
+
+  Intrinsics (camera matrix, distortion) and extrinsics (laser plane, slider step, optional camera to world
+  transform) are loaded from opencv FileStorage files. All extrinsic quantities are given in camera coordinates:
+  the laser plane as (a, b, c, d) with a*x + b*y + c*z + d = 0, the slider step as the displacement of the
+  part per slider position.
+
+  prepare() intersects the undistorted ray of every line roi pixel with the laser plane once and keeps the
+  resulting points in a lookup table, already transformed to world coordinates. A sample at sub-pixel
+  position is then interpolated between its two neighbouring pixels and moved by the slider displacement:
+  a handful of multiply-adds per point.
+
+  Not thread safe; calibration must not change while another thread triangulates. Copies are independent,
+  so a background job can work on its own copy.
+  **/
+class LaserTriangulator
+{
+public:
+    LaserTriangulator();
+
+    bool    loadIntrinsics(const QString &fileName);
+    bool    loadExtrinsics(const QString &fileName);
+    bool    saveIntrinsics(const QString &fileName);
+    bool    saveExtrinsics(const QString &fileName);
+
+    void    setIntrinsics(const cv::Mat &cameraMatrix, const cv::Mat &distortion);
+    void    setLaserPlane(const cv::Vec4d &plane);
+    void    setSliderStep(const cv::Vec3d &step);
+    void    setCameraToWorld(const cv::Mat &transform);
+
+    bool    isCalibrated() const;
+    bool    prepare(const QRect &roiLine);
+    const QRect& roi() const;
+
+    /**
+      @brief    triangulate one scan sample
+      @param    y       line roi row (scan column)
+      @param    h       scan height, see TRIANGULATION_HEIGHT_RANGE
+      @param    slider  slider position (scan row)
+      @param    xyz     receives world coordinates
+      @return   false if the pixel's ray misses the laser plane
+      **/
+    inline bool triangulate(int y, double h, double slider, float *xyz) const
+    {
+        return triangulateColumn(y, float((TRIANGULATION_HEIGHT_RANGE - h) * m_dColumnScale), slider, xyz);
+    }
+
+    /**
+      @brief    triangulate a sub-pixel line position
+      @param    y       line roi row
+      @param    u       line roi column of the laser line
+      @param    slider  slider position
+      @param    xyz     receives world coordinates
+      @return   false if the pixel's ray misses the laser plane
+      **/
+    inline bool triangulateColumn(int y, float u, double slider, float *xyz) const
+    {
+        if (u < 0.0f)
+            u = 0.0f;
+        else if (u > float(m_iLutWidth - 1))
+            u = float(m_iLutWidth - 1);
+        int u0 = int(u);
+        if (u0 > m_iLutWidth - 2)
+            u0 = m_iLutWidth - 2;
+        float f = u - float(u0);
+        const float *a = &m_lut[3 * (size_t(y) * m_iLutWidth + u0)];
+        const float *b = a + 3;
+        if (a[0] != a[0] || b[0] != b[0])   //NaN: no intersection
+            return false;
+        float s = float(slider);
+        xyz[0] = a[0] + f * (b[0] - a[0]) + s * m_step[0];
+        xyz[1] = a[1] + f * (b[1] - a[1]) + s * m_step[1];
+        xyz[2] = a[2] + f * (b[2] - a[2]) + s * m_step[2];
+        return true;
+    }
+
+private:
+    static bool openStorage(cv::FileStorage *fs, const QString &fileName);
+    void    buildLut();
+
+private:
+    cv::Mat             m_cameraMatrix;     ///< 3x3 camera intrinsics
+    cv::Mat             m_distortion;       ///< distortion coefficients
+    cv::Vec4d           m_plane;            ///< laser plane in camera coordinates
+    cv::Vec3d           m_sliderStep;       ///< part displacement per slider position, camera coordinates
+    cv::Mat             m_cameraToWorld;    ///< 4x4 rigid transform, identity if not given
+    bool                m_bIntrinsics;      ///< intrinsics loaded
+    bool                m_bExtrinsics;      ///< laser plane and slider step loaded
+
+    QRect               m_roi;              ///< line roi the lut was built for
+    bool                m_bDirty;           ///< calibration changed since the lut was built
+    int                 m_iLutWidth;        ///< pixels per lut row, at least 2
+    double              m_dColumnScale;     ///< roi pixels per scan height unit
+    std::vector<float>  m_lut;              ///< x, y, z world point per roi pixel, row major; NaN if the ray misses the plane
+    float               m_step[3];          ///< slider step in world coordinates
+};
+
+#endif // TRIANGULATION_H